@@ -38,6 +38,9 @@
 #include "Texas.h"
 #include "./inc/CortexM.h"
 #include "os.h"
+#include "traffic.h"
+#include "coroutine.h"
+#include "ao.h"
 
 uint32_t sqrt32(uint32_t s);
 #define THREADFREQ 1000 // frequency in Hz of round robin scheduler
@@ -54,7 +57,6 @@ int32_t SoundAvg;
 uint32_t LightData;
 int32_t TemperatureData; // 0.1C
 // semaphores
-int32_t NewData;    // true when new numbers to display on top of LCD
 int32_t LCDmutex;   // exclusive access to LCD
 int ReDrawAxes = 0; // non-zero means redraw axes on next display task
 
@@ -69,6 +71,14 @@ enum plotstate PlotState = Accelerometer;
 
 //------------ end of Global variables shared between tasks -------------
 
+// active objects
+#define SIG_NEWDATA AO_USER_SIG       // new sound samples, update the text on the LCD
+#define SIG_TRAFFIC (AO_USER_SIG + 1) // the intersection changed, redraw it
+#define DISPLAY_PRIORITY 0
+#define DISPLAYQUEUE 4 // a lost SIG_TRAFFIC is made up by the next one
+activeObject_t DisplayAO; // Task5
+event_t DisplayQueue[DISPLAYQUEUE];
+
 //---------------- Task0 samples sound from microphone ----------------
 // Event thread run by OS in real time at 1000 Hz
 #define SOUNDRMSLENGTH 1000 // number of samples to collect before calculating RMS (may overflow if greater than 4104)
@@ -103,7 +113,7 @@ void Task0(void)
   {
     SoundAvg = soundSum / SOUNDRMSLENGTH;
     soundSum = 0;
-    OS_Signal(&NewData); // makes task5 run every 1 sec
+    AO_Post(&DisplayAO, SIG_NEWDATA, 0); // makes Task5 run every 1 sec
     time = 0;
   }
 }
@@ -171,6 +181,8 @@ enum state AlgorithmState = LookingForMax;
 #define LIGHT_MIN 0
 #define TEMP_MAX 1023
 #define TEMP_MIN 0
+#define MAILTIMEOUT 200  // ms Task2 waits for Task1 (100ms period) before reusing old data
+uint32_t MailTimeouts;   // number of times Task2 gave up waiting
 void drawaxes(void)
 {
   OS_Wait(&LCDmutex);
@@ -191,7 +203,7 @@ void drawaxes(void)
 }
 void Task2(void)
 {
-  uint32_t data;
+  uint32_t data = 0;   // last acceleration reading, reused if Task1 goes quiet
   uint32_t localMin;   // smallest measured magnitude since odd-numbered step detected
   uint32_t localMax;   // largest measured magnitude since even-numbered step detected
   uint32_t localCount; // number of measured magnitudes above local min or below local max
@@ -201,7 +213,10 @@ void Task2(void)
   drawaxes();
   while (1)
   {
-    data = OS_MailBox_Recv(); // acceleration data from Task 1
+    if (!OS_MailBox_RecvTimeout(&data, MAILTIMEOUT))
+    { // acceleration data from Task 1 is late, keep going on the last reading
+      MailTimeouts++;
+    }
     TExaS_Task2();            // records system time in array, toggles virtual logic analyzer
     Profile_Toggle2();        // viewed by a real logic analyzer to know Task2 started
     Magnitude = sqrt32(data);
@@ -320,66 +335,69 @@ void Task2(void)
 /* ****************************************** */
 
 //------------Task3 handles switch input, buzzer output, LED output-------
+// Button1 and Button2 (PD6, PD7) belong to the pedestrian calls, see
+// PedestrianButtons, and joystick Select (PE4) to emergency preemption;
+// the plot mode is switched by tilting the joystick right or left.
+// Each direction is its own stackless coroutine, all run by Task3
+#define TILT 200 // joystick counts from either end that count as tilted
+typedef struct
+{
+  coroutine_t co;          // first, so the coroutine_t * is also a button_t *
+  uint8_t (*input)(void);  // zero if pressed
+  int step;                // how far to move through the plot states
+} button_t;
+// zero while the joystick is tilted right
+uint8_t TiltRight(void)
+{
+  uint16_t x, y;
+  uint8_t select;
+  BSP_Joystick_Input(&x, &y, &select);
+  return x < 1023 - TILT;
+}
+// zero while the joystick is tilted left
+uint8_t TiltLeft(void)
+{
+  uint16_t x, y;
+  uint8_t select;
+  BSP_Joystick_Input(&x, &y, &select);
+  return x > TILT;
+}
+button_t Button1 = {{0}, &TiltRight, 1}; // forward
+button_t Button2 = {{0}, &TiltLeft, 2};  // backward
+// *********ButtonCo*********
+// Coroutine for one tilt direction, on each tilt switch the plot mode,
+// redraw the axes and beep for one debounce time
+int ButtonCo(coroutine_t *co)
+{
+  button_t *b = (button_t *)co;
+  CO_BEGIN(co);
+  while (1)
+  {
+    CO_WAIT_UNTIL(co, b->input() != 0); // released
+    CO_SLEEP(co, 5);                    // debounce the release
+    CO_WAIT_UNTIL(co, b->input() == 0); // pressed
+    PlotState = (enum plotstate)((PlotState + b->step) % 3);
+    ReDrawAxes = 1;      // redraw axes on next call of display task
+    BSP_Buzzer_Set(512); // beep while debouncing the press
+    CO_SLEEP(co, 5);
+    BSP_Buzzer_Set(0);
+  }
+  CO_END(co);
+}
 // *********Task3*********
 // Main thread scheduled by OS round robin preemptive scheduler
 // non-real-time task
-// checks the switches, updates the mode, and outputs to the buzzer
+// checks the joystick, updates the mode, and outputs to the buzzer
 // Inputs:  none
 // Outputs: none
 void Task3(void)
 {
-  static uint8_t prev1 = 0, prev2 = 0;
-  uint8_t current;
-  BSP_Button1_Init();
-  BSP_Button2_Init();
+  BSP_Joystick_Init(); // leaves the Select edge interrupt armed
   BSP_Buzzer_Init(0);
   BSP_RGB_Init(0, 0, 0);
-  while (1)
-  {
-    BSP_Buzzer_Set(0);
-    current = BSP_Button1_Input();
-    if ((current == 0) && (prev1 != 0))
-    {
-      // Button1 was pressed since last loop
-      if (PlotState == Accelerometer)
-      {
-        PlotState = Microphone;
-      }
-      else if (PlotState == Microphone)
-      {
-        PlotState = Temperature;
-      }
-      else if (PlotState == Temperature)
-      {
-        PlotState = Accelerometer;
-      }
-      ReDrawAxes = 1;      // redraw axes on next call of display task
-      BSP_Buzzer_Set(512); // beep until next call of this task
-    }
-    prev1 = current;
-    current = BSP_Button2_Input();
-    if ((current == 0) && (prev2 != 0))
-    {
-      // Button2 was pressed since last loop
-      if (PlotState == Accelerometer)
-      {
-        PlotState = Temperature;
-      }
-      else if (PlotState == Microphone)
-      {
-        PlotState = Accelerometer;
-      }
-      else if (PlotState == Temperature)
-      {
-        PlotState = Microphone;
-      }
-      ReDrawAxes = 1;      // redraw axes on next call of display task
-      BSP_Buzzer_Set(512); // beep until next call of this task
-    }
-    prev2 = current;
-
-    BSP_Delay1ms(5); // very inefficient, but does debounce the switches
-  }
+  Co_Init(&Button1.co, &ButtonCo);
+  Co_Init(&Button2.co, &ButtonCo);
+  Co_Run(); // runs the button coroutines, does not return
 }
 /* ****************************************** */
 /*          End of Task3 Section              */
@@ -414,26 +432,32 @@ void Task4(void)
 /* ------------------------------------------ */
 //------- Task5 displays text on LCD -----------
 /* ------------------------------------------ */
-// If no data are lost, the main loop in Task5 runs exactly at 1 Hz, but not in real time
+// Task5 is an active object, run by the AO_Run thread
+// If no data are lost, Task5 handles SIG_NEWDATA exactly at 1 Hz, but not in real time
+// It also draws the LCD intersection, so every use of the LCD is by a
+// thread holding LCDmutex and none by SwitchTrafficLightTask's interrupt
 
 // *********Task5*********
-// Main thread scheduled by OS round robin preemptive scheduler
+// State handler of DisplayAO
 // updates the text at the top of the LCD
-// Inputs:  none
+// Inputs:  me is DisplayAO
+//          e is the event to handle
 // Outputs: none
-void Task5(void)
+void Task5(activeObject_t *me, const event_t *e)
 {
   int32_t soundSum;
   uint32_t soundRMS; // Root Mean Square average of most recent sound samples
-  OS_Wait(&LCDmutex);
-  BSP_LCD_DrawString(0, 0, "Time=", TOPTXTCOLOR);
-  BSP_LCD_DrawString(0, 1, "Step=", TOPTXTCOLOR);
-  BSP_LCD_DrawString(10, 0, "Temp =", TOPTXTCOLOR);
-  BSP_LCD_DrawString(10, 1, "Sound=", TOPTXTCOLOR);
-  OS_Signal(&LCDmutex);
-  while (1)
+  switch (e->sig)
   {
-    OS_Wait(&NewData);
+  case AO_SIG_INIT:
+    OS_Wait(&LCDmutex);
+    BSP_LCD_DrawString(0, 0, "Time=", TOPTXTCOLOR);
+    BSP_LCD_DrawString(0, 1, "Step=", TOPTXTCOLOR);
+    BSP_LCD_DrawString(10, 0, "Temp =", TOPTXTCOLOR);
+    BSP_LCD_DrawString(10, 1, "Sound=", TOPTXTCOLOR);
+    OS_Signal(&LCDmutex);
+    break;
+  case SIG_NEWDATA:
     TExaS_Task5();     // records system time in array, toggles virtual logic analyzer
     Profile_Toggle5(); // viewed by a real logic analyzer to know Task5 started
     soundSum = 0;
@@ -452,52 +476,208 @@ void Task5(void)
     BSP_LCD_SetCursor(16, 1);
     BSP_LCD_OutUDec4(soundRMS, SOUNDCOLOR);
     OS_Signal(&LCDmutex);
+    break;
+  case SIG_TRAFFIC:
+    OS_Wait(&LCDmutex);
+    Traffic_Draw(&TrafficCtrl);
+    OS_Signal(&LCDmutex);
+    break;
+  default:
+    break;
   }
 }
+// *********Task5_Init*********
+// starts the display active object
+// Inputs:  none
+// Outputs: none
+void Task5_Init(void)
+{
+  AO_Start(&DisplayAO, DISPLAY_PRIORITY, DisplayQueue, DISPLAYQUEUE, &Task5);
+}
+// *********TrafficChanged*********
+// Redraw request of the LCD intersection, hands it to Task5
+// Inputs:  none
+// Outputs: none
+void TrafficChanged(void)
+{
+  AO_Post(&DisplayAO, SIG_TRAFFIC, 0);
+}
 /* ****************************************** */
 /*          End of Task5 Section              */
 /* ****************************************** */
 // *********Task7*********
 // Main thread scheduled by OS round robin preemptive scheduler
-// Task7 does nothing but never blocks or sleeps
+// Task7 wakes every 10 ms to copy out the measurements; the
+// kernel's idle thread has the processor the rest of the time
 // Inputs:  none
 // Outputs: none
 // Use for watching Joystick Press 
+// CpuLoad is the headroom figure, OS_CpuLoad in 0.1% units.
+// Also copies out the interrupt latency probe: with LATENCY_PRIORITY
+// below KERNEL_BASEPRI the worst case stays at the hardware entry
+// time, since kernel critical sections never mask it; set it to
+// KERNEL_BASEPRI or more to see the cost of the kernel masking it.
+#define LATENCY_PROBE 0      // 1 to run the interrupt latency probe
+#define LATENCY_PRIORITY 0   // NVIC priority of the probe interrupt
+#define LATENCY_PERIOD 80021 // bus cycles, about 1 ms, drifts against the tick
 uint32_t Count7;
+uint32_t LatencyWorstCycles; // worst request to handler time of the probe
+uint32_t CpuLoad;            // 0.1% units
 void Task7(void)
 {
   Count7 = 0;
   while (1)
   {
     Count7++;
-    WaitForInterrupt();
+#if LATENCY_PROBE
+    LatencyWorstCycles = BSP_LatencyProbe_Max();
+#endif
+    CpuLoad = OS_CpuLoad();
+    OS_Sleep(10);
   }
 }
-// Check Mailbox from Task 7 and run flashing RED LEDs
+// Check Mailbox and run flashing RED LEDs
 // Outputs time to FIFO for Task 9
+// Also the signal-to-run benchmark: with MAILBENCH 1, MailBench posts
+// the cycle count every 10 ms, and Task8 records how long the post took
+// to reach it.  The benchmark has its own slot and semaphore, so it
+// never steals the Task1 to Task2 MailBox.
+// With MAILBENCH_PREEMPT 1 Task8 outranks Task7, so OS_Signal switches
+// to it at once (a few usec); with 0 it waits for Task7's slice to end
+// (up to 1 ms).  OS_MaxSignalLatency() gives the kernel-side figure.
+#define MAILBENCH 0         // 1 to run the signal-to-run benchmark
+#define MAILBENCH_PREEMPT 1
 uint32_t Count8;
+uint32_t MailWorstCycles;   // worst send to receive time
+int32_t MailBenchSend;      // semaphore, a stamp is waiting
+uint32_t MailBenchStamp;    // cycle count when MailBench posted
 void Task8(void)
 {
+#if MAILBENCH
+  uint32_t latency;
+#endif
   Count8 = 0;
+  MailWorstCycles = 0;
   while (1)
   {
-    Count8++;
+#if MAILBENCH
+    OS_Wait(&MailBenchSend);
+    latency = DWTCYCCNT - MailBenchStamp;
+    if (latency > MailWorstCycles)
+    {
+      MailWorstCycles = latency;
+    }
+#else
     WaitForInterrupt();
+#endif
+    Count8++;
+  }
+}
+// *********MailBench*********
+// Periodic event thread, posts the current cycle count to Task8
+void MailBench(void)
+{
+  MailBenchStamp = DWTCYCCNT;
+  OS_Signal(&MailBenchSend);
+}
+//---------------- Emergency events run by the sporadic server ----------------
+// Aperiodic emergency work is posted to the OS sporadic server, which runs it
+// above the main threads but never uses more than EMERGENCY_BUDGET cycles in
+// any EMERGENCY_PERIOD ms, so the periodic event threads keep their deadlines.
+// EmergencySim stands in for a source of such work: a 1 kHz
+// event thread that posts bursts of 1 to 4 jobs at pseudo-random times.
+// A burst that fits the budget is served within one replenish period of the
+// backlog ahead of it; EmergencyWorstUs shows what was actually observed.
+#define EMERGENCY_SIM 0       // 1 to generate simulated emergency load
+#define EMERGENCY_BUDGET 8000 // cycles per period (100 us at 80 MHz)
+#define EMERGENCY_PERIOD 10   // replenish period in ms
+#define EMERGENCY_WORK 2000   // cycles of handling per simulated job
+uint32_t EmergencyCount;      // emergency jobs completed
+uint32_t EmergencyWorstUs;    // worst post to completion time, usec
+void EmergencyJob(void)
+{
+  uint32_t start = DWTCYCCNT;
+  EmergencyCount++;
+  while ((DWTCYCCNT - start) < EMERGENCY_WORK)
+  {
+  } // simulated handling cost
+}
+void EmergencySim(void)
+{
+  static uint32_t lfsr = 0xACE1;
+  int burst;
+  lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u); // 16-bit Galois LFSR
+  if ((lfsr & 0x1F) == 0)
+  { // about one tick in 32
+    burst = 1 + ((lfsr >> 5) & 3);
+    while (burst--)
+    {
+      OS_Sporadic_Post(&EmergencyJob);
+    }
   }
+  EmergencyWorstUs = OS_Sporadic_MaxResponse() / (BSP_Clock_GetFreq() / 1000000);
 }
 // Task 9 Filesystem output task that runs at low priority
 // Adds time that an emergency interrupt happened to FAT
+
+// pedestrian buttons interrupt at the OS tick's priority, so a call is
+// latched between runs of SwitchTrafficLightTask, never during one
+#define PED_PRIORITY TIMER_PRIORITY
+// the emergency (joystick Select) input interrupts above the kernel's
+// mask, so a press is timed at once even during a critical section;
+// its second half preempts the LCD intersection at the tick's priority.
+// View PreemptWorstMs, press to green, against PreemptBoundMs
+#define EMERGENCY_PRIORITY 0
+// cycles for a critical section versus a bit-band store or LDREX/STREX,
+// measured once at startup, view in the debugger
+bitbandCycles_t BitBandCycles;
 int main(void)
 {
   OS_Init();
+  BitBand_Measure(&BitBandCycles);
   BSP_LCD_Init();
-	OS_InitSemaphore(&LCDmutex, 0);
+	OS_InitSemaphore(&LCDmutex, 1);
+  OS_NameSemaphore(&LCDmutex, "LCD");
 	//BSP_LCD_FillScreen(LCD_BLACK); Synonymous with below
   BSP_LCD_FillScreen(BSP_LCD_Color565(0, 0, 0));
   Time = 0;
+#if OS_CYCLIC
+  // the cyclic executive runs only the first main thread, as its
+  // background loop; AO_Run keeps the LCD text and intersection drawn
+  OS_AddThread(&AO_Run);
+#else
   OS_AddThreads(&Task7, &Task8);
-  AddTrafficLights();
-  OS_AddPeriodicEventThread(&SwitchTrafficLightTask, 2000); // Period: 2000 ms
+  OS_AddThread(&Task3); // button coroutines
+  OS_AddThread(&AO_Run); // dispatches DisplayAO (Task5)
+#endif
+  Task5_Init();
+  OS_MailBox_Init();
+#if MAILBENCH
+  OS_InitSemaphore(&MailBenchSend, 0);
+  OS_NameSemaphore(&MailBenchSend, "Bench");
+#if MAILBENCH_PREEMPT
+  OS_SetPriority(&Task8, DEFAULT_PRIORITY - 1);
+#endif
+#endif
+  AddTrafficLights(&TrafficChanged); // drawn by Task5
+#if OS_CYCLIC
+  OS_AddPeriodicEventThread(&SwitchTrafficLightTask, TRAFFIC_SLOT); // fixed slot in the frame table
+#else
+  OS_AddPeriodicEventThread(&SwitchTrafficLightTask, TrafficCtrl.next - OS_Time()); // first phase change, then it re-times itself
+  OS_SetOverrunPolicy(&SwitchTrafficLightTask, OVERRUN_SKIP); // keep the signal phase under load
+#endif
+  BSP_Buttons_InitInterrupt(&PedestrianButtons, PED_PRIORITY); // pedestrian calls own PD6, PD7
+  BSP_Select_InitInterrupt(&EmergencyPress, EMERGENCY_PRIORITY, &EmergencyPreempt, TIMER_PRIORITY);
+  OS_Sporadic_Init(EMERGENCY_BUDGET, EMERGENCY_PERIOD);
+#if EMERGENCY_SIM
+  OS_AddPeriodicEventThread(&EmergencySim, 1);
+#endif
+#if MAILBENCH
+  OS_AddPeriodicEventThread(&MailBench, 10);
+#endif
+#if LATENCY_PROBE
+  BSP_LatencyProbe_Init(LATENCY_PERIOD, LATENCY_PRIORITY);
+#endif
   OS_Launch(BSP_Clock_GetFreq() / THREADFREQ);              // doesn't return, interrupts enabled in here
   return 0;                                                 // this never executes
 }
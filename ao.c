@@ -0,0 +1,115 @@
+// ao.c
+// Runs on LM4F120/TM4C123/MSP432
+// Active object dispatcher, runs inside one OS main thread.
+// See ao.h for how to write a state handler.
+
+#include "ao.h"
+
+static activeObject_t *AOTable[AO_MAXOBJECTS]; // indexed by priority
+static uint32_t AOReadySet; // bit p set while AOTable[p] has events, bit-band access
+static int32_t AOPending;   // events queued across all objects, semaphore
+
+// ******** AO_Start ************
+// Register an active object and queue its AO_SIG_INIT event
+// Inputs:  me is the active object, which must stay allocated
+//          priority 0 (highest) to AO_MAXOBJECTS-1, one object per level
+//          queue and size give storage for its pending events
+//          initial is the first state handler
+// Outputs: 1 if successful, 0 if the priority is invalid or taken
+int AO_Start(activeObject_t *me, uint8_t priority, event_t *queue, uint8_t size,
+             aoHandler_t initial)
+{
+  long crit;
+  if ((priority >= AO_MAXOBJECTS) || (size == 0))
+  {
+    return 0;
+  }
+  crit = OS_StartCritical();
+  if (AOTable[priority] != NULL)
+  {
+    OS_EndCritical(crit);
+    return 0;
+  }
+  me->state = initial;
+  me->queue = queue;
+  me->size = size;
+  me->head = 0;
+  me->count = 0;
+  me->priority = priority;
+  me->lost = 0;
+  AOTable[priority] = me;
+  OS_EndCritical(crit);
+  return AO_Post(me, AO_SIG_INIT, 0);
+}
+
+// ******** AO_Post ************
+// Queue an event for an active object, does not block
+// May be called from main threads, event threads, ISRs or handlers
+// Inputs:  me is the active object
+//          sig and par describe the event
+// Outputs: 1 if queued, 0 if the queue was full (event lost)
+int AO_Post(activeObject_t *me, uint16_t sig, uint32_t par)
+{
+  event_t *e;
+  long crit = OS_StartCritical();
+  if (me->count >= me->size)
+  {
+    me->lost++;
+    OS_EndCritical(crit);
+    return 0;
+  }
+  e = &me->queue[(me->head + me->count) % me->size];
+  e->sig = sig;
+  e->par = par;
+  me->count++;
+  Flag_Set(AOReadySet, me->priority); // with the count, so AO_Run never clears it before this
+  OS_EndCritical(crit);
+  OS_Signal(&AOPending); // wakes AO_Run
+  return 1;
+}
+
+// ******** AO_Tran ************
+// Change state from inside a state handler; the old state gets
+// AO_SIG_EXIT and the new one AO_SIG_ENTRY before AO_Tran returns
+// Inputs:  me is the active object
+//          target is the new state handler
+// Outputs: none
+void AO_Tran(activeObject_t *me, aoHandler_t target)
+{
+  static const event_t exitEvt = {AO_SIG_EXIT, 0};
+  static const event_t entryEvt = {AO_SIG_ENTRY, 0};
+  me->state(me, &exitEvt);
+  me->state = target;
+  target(me, &entryEvt);
+}
+
+// ******** AO_Run ************
+// Main thread that dispatches events to the active objects, add it
+// with OS_AddThread; blocks while every queue is empty
+// Inputs:  none
+// Outputs: none (does not return)
+void AO_Run(void)
+{
+  activeObject_t *me;
+  event_t e;
+  uint8_t p;
+  long crit;
+  while (1)
+  {
+    OS_Wait(&AOPending); // one event is waiting somewhere
+    crit = OS_StartCritical();
+    for (p = 0; (AOReadySet & (1u << p)) == 0; p++)
+    {
+    } // highest priority object with events
+    me = AOTable[p];
+    e = me->queue[me->head]; // copy, the slot can be reused once released
+    me->head = (me->head + 1) % me->size;
+    me->count--;
+    if (me->count == 0)
+    {
+      Flag_Clear(AOReadySet, p);
+    }
+    OS_EndCritical(crit);
+    me->state(me, &e); // run to completion
+  }
+}
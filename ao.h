@@ -0,0 +1,86 @@
+// ao.h
+// Runs on LM4F120/TM4C123/MSP432
+// Active objects: event driven, run-to-completion alternative to
+// blocking main threads.  Each active object has its own event queue
+// and a current state handler; one main thread (AO_Run) dispatches
+// every active object, highest priority first, on one shared stack.
+
+// A state handler is called once per event and must return without
+// blocking (no OS_Wait on an empty semaphore, no OS_Sleep), since
+// while it runs no other active object can.  Short waits on a mutex
+// that is only held briefly are tolerated.
+//
+//   void Counting(activeObject_t *me, const event_t *e){
+//     switch(e->sig){
+//       case AO_SIG_ENTRY: ...; break;
+//       case SIG_TICK:     ...; break;
+//       case SIG_STOP:     AO_Tran(me, &Stopped); break;
+//     }
+//   }
+
+#ifndef __AO_H
+#define __AO_H 1
+#include <stdint.h>
+#include "os.h"
+
+#define AO_MAXOBJECTS 8 // active objects, also the number of priority levels
+
+// signals reserved by the framework, user signals start at AO_USER_SIG
+#define AO_SIG_INIT 0  // first event, delivered once after AO_Start
+#define AO_SIG_ENTRY 1 // state entered by AO_Tran
+#define AO_SIG_EXIT 2  // state left by AO_Tran
+#define AO_USER_SIG 3
+
+typedef struct
+{
+  uint16_t sig; // what happened
+  uint32_t par; // optional parameter
+} event_t;
+
+typedef struct activeObject activeObject_t;
+typedef void (*aoHandler_t)(activeObject_t *me, const event_t *e);
+struct activeObject
+{
+  aoHandler_t state; // current state handler
+  event_t *queue;    // ring buffer of pending events
+  uint8_t size;      // queue capacity
+  uint8_t head;      // next event to dispatch
+  uint8_t count;     // events waiting
+  uint8_t priority;  // 0 is highest
+  uint32_t lost;     // events dropped because the queue was full
+};
+
+// ******** AO_Start ************
+// Register an active object and queue its AO_SIG_INIT event
+// Inputs:  me is the active object, which must stay allocated
+//          priority 0 (highest) to AO_MAXOBJECTS-1, one object per level
+//          queue and size give storage for its pending events
+//          initial is the first state handler
+// Outputs: 1 if successful, 0 if the priority is invalid or taken
+// Called after OS_Init, before or after OS_Launch
+int AO_Start(activeObject_t *me, uint8_t priority, event_t *queue, uint8_t size,
+             aoHandler_t initial);
+
+// ******** AO_Post ************
+// Queue an event for an active object, does not block
+// May be called from main threads, event threads, ISRs or handlers
+// Inputs:  me is the active object
+//          sig and par describe the event
+// Outputs: 1 if queued, 0 if the queue was full (event lost)
+int AO_Post(activeObject_t *me, uint16_t sig, uint32_t par);
+
+// ******** AO_Tran ************
+// Change state from inside a state handler; the old state gets
+// AO_SIG_EXIT and the new one AO_SIG_ENTRY before AO_Tran returns
+// Inputs:  me is the active object
+//          target is the new state handler
+// Outputs: none
+void AO_Tran(activeObject_t *me, aoHandler_t target);
+
+// ******** AO_Run ************
+// Main thread that dispatches events to the active objects, add it
+// with OS_AddThread; blocks while every queue is empty
+// Inputs:  none
+// Outputs: none (does not return)
+void AO_Run(void);
+#endif
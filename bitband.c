@@ -0,0 +1,99 @@
+// bitband.c
+// Runs on LM4F120/TM4C123
+// Atomic counters and the cycle comparison for bitband.h.
+
+#include <stdint.h>
+#include "./inc/CortexM.h"
+#include "bitband.h"
+
+// ******** Atomic_Add ************
+// Add to a counter that interrupts also change, without
+// disabling interrupts (retries if it was interrupted)
+// Inputs:  pointer to the counter
+//          amount to add, may be negative
+// Outputs: new value of the counter
+int32_t Atomic_Add(volatile int32_t *counter, int32_t amount)
+{
+  int32_t value;
+  do
+  { // an exception between LDREX and STREX makes STREX fail
+    value = __ldrex(counter) + amount;
+  } while (__strex(value, counter));
+  return value;
+}
+
+#define MEASURERUNS 8 // best of this many, hides a tick landing in one of them
+static uint32_t MeasureFlags;
+static volatile int32_t MeasureCount;
+
+// smallest of the old best and this run, less the cost of the reads
+static uint32_t best(uint32_t old, uint32_t start, uint32_t end, uint32_t empty)
+{
+  uint32_t t = end - start - empty;
+  return (t < old) ? t : old;
+}
+
+// ******** BitBand_Measure ************
+// Time each flag and counter update with the DWT cycle counter
+// Call with interrupts enabled, numbers are the best of several runs
+// Inputs:  where to put the results
+// Outputs: none
+void BitBand_Measure(bitbandCycles_t *result)
+{
+  uint32_t start, end, empty;
+  volatile uint32_t seen;
+  long crit;
+  int i;
+  result->critSet = result->bandSet = 0xFFFFFFFF;
+  result->critTest = result->bandTest = 0xFFFFFFFF;
+  result->critInc = result->atomInc = 0xFFFFFFFF;
+  empty = 0xFFFFFFFF;
+  for (i = 0; i < MEASURERUNS; i++)
+  {
+    start = DWTCYCCNT;
+    end = DWTCYCCNT;
+    if (end - start < empty)
+    {
+      empty = end - start;
+    }
+  }
+  for (i = 0; i < MEASURERUNS; i++)
+  {
+    start = DWTCYCCNT;
+    crit = StartCritical();
+    MeasureFlags |= 1u << 5;
+    EndCritical(crit);
+    end = DWTCYCCNT;
+    result->critSet = best(result->critSet, start, end, empty);
+
+    start = DWTCYCCNT;
+    Flag_Set(MeasureFlags, 5);
+    end = DWTCYCCNT;
+    result->bandSet = best(result->bandSet, start, end, empty);
+
+    start = DWTCYCCNT;
+    crit = StartCritical();
+    seen = MeasureFlags & (1u << 5);
+    EndCritical(crit);
+    end = DWTCYCCNT;
+    result->critTest = best(result->critTest, start, end, empty);
+
+    start = DWTCYCCNT;
+    seen = Flag_Test(MeasureFlags, 5);
+    end = DWTCYCCNT;
+    result->bandTest = best(result->bandTest, start, end, empty);
+
+    start = DWTCYCCNT;
+    crit = StartCritical();
+    MeasureCount++;
+    EndCritical(crit);
+    end = DWTCYCCNT;
+    result->critInc = best(result->critInc, start, end, empty);
+
+    start = DWTCYCCNT;
+    Atomic_Add(&MeasureCount, 1);
+    end = DWTCYCCNT;
+    result->atomInc = best(result->atomInc, start, end, empty);
+  }
+  (void)seen;
+}
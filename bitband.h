@@ -0,0 +1,64 @@
+// bitband.h
+// Runs on LM4F120/TM4C123
+// Atomic single-bit flags on the Cortex-M4 bit-band alias regions,
+// plus atomic counters built on LDREX/STREX.
+// SRAM 0x20000000-0x200FFFFF has a bit-band alias at 0x22000000 and
+// peripherals 0x40000000-0x400FFFFF have one at 0x42000000; each bit
+// of the original word is one word in the alias, so a store of 1 or 0
+// to the alias sets or clears that bit without touching the others.
+// The bus does the read-modify-write, so no critical section is needed.
+//
+// Flags must live in SRAM (globals and statics, not const tables):
+//   static uint32_t Ready;      // up to 32 flags
+//   Flag_Set(Ready, 3);         // one store
+//   if (Flag_Test(Ready, 3)) ...
+// Flag_Set/Flag_Clear only make a single bit atomic; updating several
+// fields together still needs StartCritical/EndCritical.
+
+#ifndef BITBAND_H
+#define BITBAND_H
+#include <stdint.h>
+
+// word in the alias region that mirrors bit b of the word at address a
+#define BITBAND(a, b) (*((volatile uint32_t *)(((uint32_t)(a) & 0xF0000000) | 0x02000000 | \
+                                               (((uint32_t)(a) & 0x000FFFFF) << 5) | ((b) << 2))))
+
+// ******** Flag_Set ************
+// Set bit b (0 to 31) of the uint32_t variable w
+#define Flag_Set(w, b) (BITBAND(&(w), (b)) = 1)
+
+// ******** Flag_Clear ************
+// Clear bit b (0 to 31) of the uint32_t variable w
+#define Flag_Clear(w, b) (BITBAND(&(w), (b)) = 0)
+
+// ******** Flag_Test ************
+// 1 if bit b (0 to 31) of the uint32_t variable w is set, 0 if not
+#define Flag_Test(w, b) (BITBAND(&(w), (b)))
+
+// ******** Atomic_Add ************
+// Add to a counter that interrupts also change, without
+// disabling interrupts (retries if it was interrupted)
+// Inputs:  pointer to the counter
+//          amount to add, may be negative
+// Outputs: new value of the counter
+int32_t Atomic_Add(volatile int32_t *counter, int32_t amount);
+
+// cycles taken by each way of updating shared state, see BitBand_Measure
+typedef struct
+{
+  uint32_t critSet;  // StartCritical, |= bit, EndCritical
+  uint32_t bandSet;  // Flag_Set
+  uint32_t critTest; // StartCritical, & bit, EndCritical
+  uint32_t bandTest; // Flag_Test
+  uint32_t critInc;  // StartCritical, ++, EndCritical
+  uint32_t atomInc;  // Atomic_Add
+} bitbandCycles_t;
+
+// ******** BitBand_Measure ************
+// Time each flag and counter update with the DWT cycle counter
+// Call with interrupts enabled, numbers are the best of several runs
+// Inputs:  where to put the results
+// Outputs: none
+void BitBand_Measure(bitbandCycles_t *result);
+
+#endif
@@ -0,0 +1,82 @@
+// coroutine.c
+// Runs on LM4F120/TM4C123/MSP432
+// Stackless coroutine scheduler, runs inside one OS main thread.
+// See coroutine.h for how to write a coroutine.
+
+#include "coroutine.h"
+
+static coroutine_t *CoList; // coroutines that have not ended
+static coroutine_t *CoNew;  // added since the last pass, not yet in CoList
+
+// ******** Co_Init ************
+// Prepare a coroutine and hand it to the scheduler
+// Inputs:  co is the coroutine, which must stay allocated while it runs
+//          body is the coroutine function
+// Outputs: none
+void Co_Init(coroutine_t *co, int (*body)(coroutine_t *co))
+{
+  long crit;
+  co->lc = 0;
+  co->wake = 0;
+  co->body = body;
+  crit = OS_StartCritical();
+  co->next = CoNew; // Co_Run moves it to CoList between passes
+  CoNew = co;
+  OS_EndCritical(crit);
+}
+
+// ******** Co_Expired ************
+// true once OS time has reached time, wraparound safe
+// Inputs:  time in ticks
+// Outputs: nonzero if OS_Time() >= time
+int Co_Expired(uint32_t time)
+{
+  return (int32_t)(OS_Time() - time) >= 0;
+}
+
+// ******** Co_Run ************
+// Main thread that runs the coroutines, add it with OS_AddThread
+// Runs every coroutine in turn; when none of them can make progress
+// it sleeps until the next tick, so coroutines waiting on semaphores
+// or mail are polled once per msec and sleeping ones cost nothing
+// Inputs:  none
+// Outputs: none (does not return)
+void Co_Run(void)
+{
+  coroutine_t **link, *co;
+  int progress;
+  long crit;
+  while (1)
+  {
+    crit = OS_StartCritical();
+    while ((co = CoNew) != NULL)
+    { // pick up coroutines added since the last pass
+      CoNew = co->next;
+      co->next = CoList;
+      CoList = co;
+    }
+    OS_EndCritical(crit);
+    progress = 0;
+    link = &CoList;
+    while ((co = *link) != NULL)
+    {
+      switch (co->body(co))
+      {
+      case CO_ENDED:
+        *link = co->next; // unlink, it never runs again
+        progress = 1;
+        continue;
+      case CO_YIELDED:
+        progress = 1;
+        break;
+      default:
+        break;
+      }
+      link = &co->next;
+    }
+    if (!progress)
+    {
+      OS_Sleep(1); // everything is waiting, nothing changes before the next tick
+    }
+  }
+}
@@ -0,0 +1,112 @@
+// coroutine.h
+// Runs on LM4F120/TM4C123/MSP432
+// Stackless coroutines (protothreads) that run inside one OS main thread.
+// Each coroutine costs a coroutine_t (16 bytes) instead of a TCB plus
+// a STACKSIZE stack, so signal heads, detectors and buttons can each
+// be their own task.
+
+// A coroutine is a function that starts with CO_BEGIN, ends with
+// CO_END, and gives up the CPU only at the CO_ macros between them.
+// It has no stack of its own: local variables do not survive a
+// CO_YIELD, CO_SLEEP or CO_WAIT_UNTIL, so keep state in static
+// variables or in a struct that embeds the coroutine_t.
+// Do not use switch statements around the CO_ macros.
+//
+//   int Blink(coroutine_t *co){
+//     CO_BEGIN(co);
+//     while(1){
+//       BSP_RGB_D_Toggle(1, 0, 0);
+//       CO_SLEEP(co, 500);
+//     }
+//     CO_END(co);
+//   }
+//
+// Coroutines never call OS_Wait, OS_Sleep or anything else that
+// blocks; that would stop every coroutine in the host thread.
+
+#ifndef __COROUTINE_H
+#define __COROUTINE_H 1
+#include <stdint.h>
+#include "os.h"
+
+#define CO_WAITING 0 // waiting for a condition or a time
+#define CO_YIELDED 1 // gave up the CPU but can run again
+#define CO_ENDED 2   // reached CO_END, removed from the scheduler
+
+typedef struct coroutine
+{
+  uint32_t lc;                       // resume point (source line), 0 at the start
+  uint32_t wake;                     // OS time to resume at, used by CO_SLEEP
+  int (*body)(struct coroutine *co); // returns CO_WAITING, CO_YIELDED or CO_ENDED
+  struct coroutine *next;            // linked-list pointer
+} coroutine_t;
+
+#define CO_BEGIN(co) \
+  switch ((co)->lc)  \
+  {                  \
+  case 0:
+
+#define CO_END(co) \
+  }                \
+  (co)->lc = 0;    \
+  return CO_ENDED
+
+// give the other coroutines a turn
+#define CO_YIELD(co)       \
+  do                       \
+  {                        \
+    (co)->lc = __LINE__;   \
+    return CO_YIELDED;     \
+  case __LINE__:;          \
+  } while (0)
+
+// resume only once cond is true, cond is checked every time the host runs
+#define CO_WAIT_UNTIL(co, cond) \
+  do                            \
+  {                             \
+    (co)->lc = __LINE__;        \
+  case __LINE__:                \
+    if (!(cond))                \
+    {                           \
+      return CO_WAITING;        \
+    }                           \
+  } while (0)
+
+// resume after ticks msec, like OS_Sleep
+#define CO_SLEEP(co, ticks)                 \
+  do                                        \
+  {                                         \
+    (co)->wake = OS_Time() + (ticks);       \
+    CO_WAIT_UNTIL(co, Co_Expired((co)->wake)); \
+  } while (0)
+
+// decrement semaphore, waiting (not blocking) until it is positive, like OS_Wait
+#define CO_SEM_WAIT(co, semaPt) CO_WAIT_UNTIL(co, OS_TryWait(semaPt))
+
+// receive mail, waiting (not blocking) until there is some, like OS_MailBox_Recv
+#define CO_MAILBOX_RECV(co, dataPt) CO_WAIT_UNTIL(co, OS_MailBox_TryRecv(dataPt))
+
+// ******** Co_Init ************
+// Prepare a coroutine and hand it to the scheduler
+// Inputs:  co is the coroutine, which must stay allocated while it runs
+//          body is the coroutine function
+// Outputs: none
+// May be called from anywhere, including coroutines and ISRs,
+// but not on a coroutine that has not yet ended
+void Co_Init(coroutine_t *co, int (*body)(coroutine_t *co));
+
+// ******** Co_Run ************
+// Main thread that runs the coroutines, add it with OS_AddThread
+// Runs every coroutine in turn; when none of them can make progress
+// it sleeps until the next tick, so coroutines waiting on semaphores
+// or mail are polled once per msec and sleeping ones cost nothing
+// Inputs:  none
+// Outputs: none (does not return)
+void Co_Run(void);
+
+// ******** Co_Expired ************
+// true once OS time has reached time, wraparound safe
+// Inputs:  time in ticks
+// Outputs: nonzero if OS_Time() >= time
+int Co_Expired(uint32_t time);
+#endif
@@ -223,6 +223,52 @@ uint8_t BSP_Button2_Input(void){
   return BUTTON2;                  // return 0(pressed) or 0x80(not pressed)
 }
 
+// ------------BSP_Buttons_InitInterrupt------------
+// Initialize Button1 (J4.33) and Button2 (J4.32) to request
+// an interrupt when pressed (falling edge), so they need not
+// be polled.  Button bounce gives more than one edge per
+// press, so task must not mind being called again.
+// Input: task is the user function called from the GPIO
+//          Port D ISR, with bit 0 set if Button1 was pressed
+//          and bit 1 set if Button2 was
+//        priority is a number 0 to 7
+// Output: none
+static void (*ButtonTask)(uint32_t pressed);
+void BSP_Buttons_InitInterrupt(void(*task)(uint32_t pressed), uint8_t priority){long sr;
+  if(priority > 7){
+    priority = 7;
+  }
+  sr = StartCritical();
+  ButtonTask = task;
+  BSP_Button1_Init();
+  BSP_Button2_Init();
+  GPIO_PORTD_IS_R &= ~0xC0;        // PD7-6 are edge-sensitive
+  GPIO_PORTD_IBE_R &= ~0xC0;       // not both edges
+  GPIO_PORTD_IEV_R &= ~0xC0;       // falling edge, a press pulls the pin low
+  GPIO_PORTD_ICR_R = 0xC0;         // clear flags 7-6
+  GPIO_PORTD_IM_R |= 0xC0;         // arm interrupts on PD7-6
+//PRIn Bit   Interrupt
+//Bits 31:29 Interrupt [4n+3], n=0 => (4n+3)=3
+  NVIC_PRI0_R = (NVIC_PRI0_R&0x1FFFFFFF)|(priority<<29); // priority
+// interrupt number 3, 32 bits in each NVIC_ENx_R register
+  NVIC_EN0_R = 1<<3;               // enable IRQ 3 in NVIC
+  EndCritical(sr);
+}
+
+void GPIOPortD_Handler(void){uint32_t flags, pressed = 0;
+  flags = GPIO_PORTD_MIS_R&0xC0;
+  GPIO_PORTD_ICR_R = flags;        // acknowledge the edges
+  if(flags&0x40){
+    pressed |= 0x01;               // Button1, PD6
+  }
+  if(flags&0x80){
+    pressed |= 0x02;               // Button2, PD7
+  }
+  if(pressed && ButtonTask){
+    (*ButtonTask)(pressed);
+  }
+}
+
 // There are six analog inputs on the Educational BoosterPack MKII:
 // microphone (J1.6/PE5/AIN8)
 // joystick X (J1.2/PB5/AIN11) and Y (J3.26/PD3/AIN4)
@@ -296,6 +342,76 @@ void BSP_Joystick_Input(uint16_t *x, uint16_t *y, uint8_t *select){
   ADC0_ISC_R = 0x0002;             // 4) acknowledge completion
 }
 
+// ------------BSP_Select_InitInterrupt------------
+// Initialize the joystick Select button (J1.5) to request an
+// interrupt when pressed (falling edge), handled in two halves.
+// The first, urgent, runs in the GPIO Port E ISR at priority
+// and should be short; it then triggers the second, task, in
+// the otherwise unused GPIO Port G ISR at taskPriority.  So
+// urgent can run above what the OS masks, while task runs
+// where it may call the OS.  Button bounce gives more than one
+// edge per press, so neither may mind being called again.
+// Input: urgent is the user function for the first half, or NULL
+//        priority is a number 0 to 7
+//        task is the user function for the second half
+//        taskPriority is a number 0 to 7, no more urgent than priority
+// Output: none
+static void (*SelectUrgent)(void);
+static void (*SelectTask)(void);
+void BSP_Select_InitInterrupt(void(*urgent)(void), uint8_t priority,
+                              void(*task)(void), uint8_t taskPriority){long sr;
+  if(priority > 7){
+    priority = 7;
+  }
+  if(taskPriority < priority){
+    taskPriority = priority;
+  }
+  if(taskPriority > 7){
+    taskPriority = 7;
+  }
+  sr = StartCritical();
+  SelectUrgent = urgent;
+  SelectTask = task;
+  SYSCTL_RCGCGPIO_R |= 0x00000010; // 1) activate clock for Port E
+  while((SYSCTL_PRGPIO_R&0x10) == 0){};// allow time for clock to stabilize
+                                   // 2) no need to unlock PE4
+  GPIO_PORTE_AMSEL_R &= ~0x10;     // 3) disable analog on PE4
+                                   // 4) configure PE4 as GPIO
+  GPIO_PORTE_PCTL_R = (GPIO_PORTE_PCTL_R&0xFFF0FFFF)+0x00000000;
+  GPIO_PORTE_DIR_R &= ~0x10;       // 5) make PE4 input
+  GPIO_PORTE_AFSEL_R &= ~0x10;     // 6) disable alt funct on PE4
+  GPIO_PORTE_DEN_R |= 0x10;        // 7) enable digital I/O on PE4
+  GPIO_PORTE_IS_R &= ~0x10;        // PE4 is edge-sensitive
+  GPIO_PORTE_IBE_R &= ~0x10;       // not both edges
+  GPIO_PORTE_IEV_R &= ~0x10;       // falling edge, a press pulls the pin low
+  GPIO_PORTE_ICR_R = 0x10;         // clear flag 4
+  GPIO_PORTE_IM_R |= 0x10;         // arm interrupt on PE4
+//PRIn Bit   Interrupt
+//Bits 7:5   Interrupt [4n], n=1 => (4n)=4
+  NVIC_PRI1_R = (NVIC_PRI1_R&0xFFFFFF1F)|(priority<<5); // priority
+//Bits 31:29 Interrupt [4n+3], n=7 => (4n+3)=31
+  NVIC_PRI7_R = (NVIC_PRI7_R&0x1FFFFFFF)|(taskPriority<<29); // taskPriority
+// interrupt numbers 4 and 31, 32 bits in each NVIC_ENx_R register
+  NVIC_EN0_R = 0x80000010;         // enable IRQ 4 and IRQ 31 in NVIC
+  EndCritical(sr);
+}
+
+void GPIOPortE_Handler(void){
+  GPIO_PORTE_ICR_R = 0x10;         // acknowledge flag 4
+  if(SelectUrgent){
+    (*SelectUrgent)();
+  }
+  NVIC_SW_TRIG_R = 31;             // pend the second half, IRQ 31
+}
+
+// GPIO Port G is not bonded out on the TM4C123GH6PM, so its
+// vector only ever runs when software triggers it
+void GPIOPortG_Handler(void){
+  if(SelectTask){
+    (*SelectTask)();
+  }
+}
+
 // ------------BSP_RGB_Init------------
 // Initialize the GPIO and PWM or timer modules which
 // correspond with BoosterPack pins J4.39 (red),
@@ -2244,6 +2360,139 @@ void BSP_PeriodicTask_StopC(void){
   NVIC_DIS3_R = 1<<4;              // disable IRQ 100 in NVIC
 }
 
+// ------------BSP_OneShotTask_Init------------
+// Prepare an interrupt to run a user task once,
+// a programmable delay after BSP_OneShotTask_Start.
+// The timer is left stopped.
+// Give it a priority 0 to 6 with lower numbers
+// signifying higher priority.  Equal priority is
+// handled sequentially.
+// Input:  task is a pointer to a user function
+//         priority is a number 0 to 6
+// Output: none
+void (*OneShotTask)(void);   // user function
+void BSP_OneShotTask_Init(void(*task)(void), uint8_t priority){long sr;
+  if(priority > 6){
+    priority = 6;
+  }
+  sr = StartCritical();
+  OneShotTask = task;              // user function
+  // ***************** Wide Timer2A initialization *****************
+  SYSCTL_RCGCWTIMER_R |= 0x04;     // activate clock for Wide Timer2
+  while((SYSCTL_PRWTIMER_R&0x04) == 0){};// allow time for clock to stabilize
+  WTIMER2_CTL_R &= ~TIMER_CTL_TAEN;// disable Wide Timer2A during setup
+  WTIMER2_CFG_R = TIMER_CFG_16_BIT;// configure for 32-bit timer mode
+                                   // configure for one-shot mode, default down-count settings
+  WTIMER2_TAMR_R = TIMER_TAMR_TAMR_1_SHOT;
+  WTIMER2_TAPR_R = 0;              // bus clock resolution
+  WTIMER2_ICR_R = TIMER_ICR_TATOCINT;// clear WTIMER2A timeout flag
+  WTIMER2_IMR_R |= TIMER_IMR_TATOIM;// arm timeout interrupt
+//PRIn Bit   Interrupt
+//Bits 31:29 Interrupt [4n+3]
+//Bits 23:21 Interrupt [4n+2], n=24 => (4n+2)=98
+//Bits 15:13 Interrupt [4n+1]
+//Bits 7:5   Interrupt [4n]
+  NVIC_PRI24_R = (NVIC_PRI24_R&0xFF00FFFF)|(priority<<21); // priority
+// vector number 114, interrupt number 98
+// 32 bits in each NVIC_ENx_R register, 98/32 = 3 remainder 2
+  NVIC_EN3_R = 1<<2;               // enable IRQ 98 in NVIC
+  EndCritical(sr);
+}
+
+// ------------BSP_OneShotTask_Start------------
+// Start (or restart) the one-shot delay.  The user
+// task runs once, from the interrupt, when it expires.
+// Input:  us is the delay in microseconds
+//           1 to 53,000,000 at 80 MHz
+// Output: none
+// Assumes: BSP_OneShotTask_Init() has been called
+void BSP_OneShotTask_Start(uint32_t us){
+  WTIMER2_CTL_R &= ~TIMER_CTL_TAEN;// stop any delay in progress
+  WTIMER2_TAILR_R = us*(ClockFrequency/1000000) - 1; // bus cycles to wait
+  WTIMER2_ICR_R = TIMER_ICR_TATOCINT;// clear WTIMER2A timeout flag
+  WTIMER2_CTL_R |= TIMER_CTL_TAEN; // enable Wide Timer2A, stops itself at zero
+}
+
+void WideTimer2A_Handler(void){
+  WTIMER2_ICR_R = TIMER_ICR_TATOCINT;// acknowledge Wide Timer2A timeout
+  (*OneShotTask)();                // execute user task
+}
+
+// ------------BSP_OneShotTask_Stop------------
+// Cancel a one-shot delay that has not yet expired.
+// Input: none
+// Output: none
+void BSP_OneShotTask_Stop(void){
+  WTIMER2_CTL_R &= ~TIMER_CTL_TAEN;// disable Wide Timer2A
+  WTIMER2_ICR_R = TIMER_ICR_TATOCINT;// clear WTIMER2A timeout flag
+}
+
+// ------------BSP_LatencyProbe_Init------------
+// Measure interrupt latency with Wide Timer 1A.  The
+// timer interrupts periodically and its handler reads how
+// far the timer has counted since the timeout, so each
+// interrupt measures the time from the request to the
+// first instruction of the handler, in bus cycles.
+// Input:  period is the bus cycles between interrupts
+//         priority is a number 0 to 7
+// Output: none
+static uint32_t LatencyMax;        // worst latency, bus cycles
+void BSP_LatencyProbe_Init(uint32_t period, uint8_t priority){long sr;
+  if(priority > 7){
+    priority = 7;
+  }
+  sr = StartCritical();
+  LatencyMax = 0;
+  // ***************** Wide Timer1A initialization *****************
+  SYSCTL_RCGCWTIMER_R |= 0x02;     // activate clock for Wide Timer1
+  while((SYSCTL_PRWTIMER_R&0x02) == 0){};// allow time for clock to stabilize
+  WTIMER1_CTL_R &= ~TIMER_CTL_TAEN;// disable Wide Timer1A during setup
+  WTIMER1_CFG_R = TIMER_CFG_16_BIT;// configure for 32-bit timer mode
+                                   // configure for periodic mode, default down-count settings
+  WTIMER1_TAMR_R = TIMER_TAMR_TAMR_PERIOD;
+  WTIMER1_TAILR_R = period - 1;    // reload value
+  WTIMER1_TAPR_R = 0;              // bus clock resolution
+  WTIMER1_ICR_R = TIMER_ICR_TATOCINT;// clear WTIMER1A timeout flag
+  WTIMER1_IMR_R |= TIMER_IMR_TATOIM;// arm timeout interrupt
+//PRIn Bit   Interrupt
+//Bits 31:29 Interrupt [4n+3]
+//Bits 23:21 Interrupt [4n+2]
+//Bits 15:13 Interrupt [4n+1]
+//Bits 7:5   Interrupt [4n], n=24 => (4n)=96
+  NVIC_PRI24_R = (NVIC_PRI24_R&0xFFFFFF00)|(priority<<5); // priority
+// vector number 112, interrupt number 96
+// 32 bits in each NVIC_ENx_R register, 96/32 = 3 remainder 0
+  NVIC_EN3_R = 1<<0;               // enable IRQ 96 in NVIC
+  WTIMER1_CTL_R |= TIMER_CTL_TAEN; // enable Wide Timer1A 32-b
+  EndCritical(sr);
+}
+
+void WideTimer1A_Handler(void){uint32_t latency;
+  latency = WTIMER1_TAILR_R - WTIMER1_TAV_R; // counts since the reload
+  WTIMER1_ICR_R = TIMER_ICR_TATOCINT;// acknowledge Wide Timer1A timeout
+  if(latency > LatencyMax){
+    LatencyMax = latency;
+  }
+}
+
+// ------------BSP_LatencyProbe_Max------------
+// Worst latency measured since BSP_LatencyProbe_Init.
+// Input:  none
+// Output: latency in bus cycles
+uint32_t BSP_LatencyProbe_Max(void){
+  return LatencyMax;
+}
+
+// ------------BSP_LatencyProbe_Stop------------
+// Stop the latency measurement.
+// Input: none
+// Output: none
+void BSP_LatencyProbe_Stop(void){
+  WTIMER1_CTL_R &= ~TIMER_CTL_TAEN;// disable Wide Timer1A
+  WTIMER1_ICR_R = TIMER_ICR_TATOCINT;// clear WTIMER1A timeout flag
+  NVIC_DIS3_R = 1<<0;              // disable IRQ 96 in NVIC
+}
+
 // ------------BSP_Time_Init------------
 // Activate a 32-bit timer to count the number of
 // microseconds since the timer was initialized.
@@ -200,6 +200,20 @@ void BSP_Button2_Init(void);
 // Assumes: BSP_Button2_Init() has been called
 uint8_t BSP_Button2_Input(void);
 
+// ------------BSP_Buttons_InitInterrupt------------
+// Initialize Button1 (J4.33) and Button2 (J4.32) to request
+// an interrupt when pressed (falling edge), so they need not
+// be polled.  Button bounce gives more than one edge per
+// press, so task must not mind being called again.  The
+// buttons then belong to task; do not also poll them with
+// BSP_Button1_Input or BSP_Button2_Input.
+// Input: task is the user function called from the GPIO
+//          Port D ISR, with bit 0 set if Button1 was pressed
+//          and bit 1 set if Button2 was
+//        priority is a number 0 to 7
+// Output: none
+void BSP_Buttons_InitInterrupt(void(*task)(uint32_t pressed), uint8_t priority);
+
 // ------------BSP_Joystick_Init------------
 // Initialize a GPIO pin for input, which corresponds
 // with BoosterPack pin J1.5 (Select button).
@@ -222,6 +236,23 @@ void BSP_Joystick_Init(void);
 // Assumes: BSP_Joystick_Init() has been called
 void BSP_Joystick_Input(uint16_t *x, uint16_t *y, uint8_t *select);
 
+// ------------BSP_Select_InitInterrupt------------
+// Initialize the joystick Select button (J1.5) to request an
+// interrupt when pressed (falling edge), handled in two halves.
+// The first, urgent, runs in the GPIO Port E ISR at priority
+// and should be short; it then triggers the second, task, in
+// the otherwise unused GPIO Port G ISR at taskPriority.  So
+// urgent can run above what the OS masks, while task runs
+// where it may call the OS.  Button bounce gives more than one
+// edge per press, so neither may mind being called again.
+// Input: urgent is the user function for the first half, or NULL
+//        priority is a number 0 to 7
+//        task is the user function for the second half
+//        taskPriority is a number 0 to 7, no more urgent than priority
+// Output: none
+void BSP_Select_InitInterrupt(void(*urgent)(void), uint8_t priority,
+                              void(*task)(void), uint8_t taskPriority);
+
 // ------------BSP_RGB_Init------------
 // Initialize the GPIO and PWM or timer modules which
 // correspond with BoosterPack pins J4.39 (red),
@@ -677,6 +708,56 @@ void BSP_PeriodicTask_InitC(void(*task)(void), uint32_t freq, uint8_t priority);
 // Output: none
 void BSP_PeriodicTask_StopC(void);
 
+// ------------BSP_OneShotTask_Init------------
+// Prepare an interrupt to run a user task once,
+// a programmable delay after BSP_OneShotTask_Start.
+// The timer is left stopped.
+// Give it a priority 0 to 6 with lower numbers
+// signifying higher priority.  Equal priority is
+// handled sequentially.
+// Input:  task is a pointer to a user function
+//         priority is a number 0 to 6
+// Output: none
+void BSP_OneShotTask_Init(void(*task)(void), uint8_t priority);
+
+// ------------BSP_OneShotTask_Start------------
+// Start (or restart) the one-shot delay.  The user
+// task runs once, from the interrupt, when it expires.
+// Input:  us is the delay in microseconds
+//           1 to 53,000,000 at 80 MHz
+// Output: none
+// Assumes: BSP_OneShotTask_Init() has been called
+void BSP_OneShotTask_Start(uint32_t us);
+
+// ------------BSP_OneShotTask_Stop------------
+// Cancel a one-shot delay that has not yet expired.
+// Input: none
+// Output: none
+void BSP_OneShotTask_Stop(void);
+
+// ------------BSP_LatencyProbe_Init------------
+// Measure interrupt latency with Wide Timer 1A.  The
+// timer interrupts periodically and its handler reads how
+// far the timer has counted since the timeout, so each
+// interrupt measures the time from the request to the
+// first instruction of the handler, in bus cycles.
+// Input:  period is the bus cycles between interrupts
+//         priority is a number 0 to 7
+// Output: none
+void BSP_LatencyProbe_Init(uint32_t period, uint8_t priority);
+
+// ------------BSP_LatencyProbe_Max------------
+// Worst latency measured since BSP_LatencyProbe_Init.
+// Input:  none
+// Output: latency in bus cycles
+uint32_t BSP_LatencyProbe_Max(void);
+
+// ------------BSP_LatencyProbe_Stop------------
+// Stop the latency measurement.
+// Input: none
+// Output: none
+void BSP_LatencyProbe_Stop(void);
+
 // ------------BSP_Time_Init------------
 // Activate a 32-bit timer to count the number of
 // microseconds since the timer was initialized.
@@ -9,14 +9,88 @@
 static int32_t MailSend;
 static volatile int32_t LostMail;
 static volatile uint32_t MailData;
+static uint32_t Fifo[FIFOSIZE];
+static uint32_t PutI, GetI;     // FIFO indices
+static int32_t CurrentSize;     // FIFO entries, semaphore
+static volatile int32_t LostFIFO;
+static uint32_t MaxSignalLatency; // cycles, OS_Signal wakeup to switch in
+static OS_SemStats_t SemStats[NUMSEMSTATS];
+static OS_SemStats_t *findstats(int32_t *semaPt);
+static void chargeblocked(OS_SemStats_t *st, struct tcb *pt);
 // function definitions in osasm.s
 void StartOS(void);
-TrafficLightPair TrafficLights[NUMLIGHTS];
 eventTask_t event_tasks[NUMPERIODIC];
+const uint32_t OSBasePri = KERNEL_BASEPRI << 5; // used by osasm.s, priority in bits 7:5
+static uint32_t PausedSet; // bit i set while event_tasks[i] is paused, bit-band access
 typedef struct tcb tcbType;
-tcbType tcbs[NUMTHREADS];
+tcbType tcbs[NUMTHREADS + 1]; // the last one is the idle thread
 tcbType *RunPt;
-int32_t Stacks[NUMTHREADS][STACKSIZE];
+int32_t Stacks[NUMTHREADS + 1][STACKSIZE];
+#define IdlePt (&tcbs[NUMTHREADS]) // runs when no main thread is ready, not in the ring
+#define IDLE_PRIORITY 255           // below any OS_SetPriority value
+static uint32_t LoadStart;  // cycle count at the start of the load window
+static uint32_t LoadIdle;   // idle cycles at the start of the load window
+static uint32_t LoadTicks;  // ticks into the load window
+static uint32_t CpuLoad;    // smoothed load, 0.1% units
+static uint32_t LoadSamples;
+#define SLEEP_ONESHOT (-1) // tcb sleep value while waiting on the one-shot timer
+static tcbType *USleepPt;   // thread that owns the one-shot timer, NULL if free
+static void wakeusleeper(void);
+static void runperiodicevents(void);
+static void idlethread(void);
+static uint32_t OSTime;        // ticks since OS_Init
+static uint32_t OSTimeWraps;   // times OSTime has wrapped, its high word
+static uint32_t LastTick;      // cycle count at the last tick
+static int TickSynced;         // LastTick locked to the tick phase
+static uint32_t CyclesPerTick; // bus cycles in one tick
+static uint8_t NumThreads;     // main threads added so far
+static uint32_t TimeSlice;     // default time slice from OS_Launch
+static uint32_t SliceStart;    // cycle count when RunPt was switched in
+// high rate event threads on their own timers, B is Wide Timer 4A, C is Wide Timer 3A
+typedef struct
+{
+  void (*task)(void);
+  uint32_t period; // clock cycles between releases
+  uint32_t last;   // cycle count at the last release, 0 before the first
+  uint32_t jitter; // worst difference from period, clock cycles
+} hwTask_t;
+static hwTask_t HWTaskB, HWTaskC;
+// sporadic server, jobs run from PendSV_Handler
+typedef struct
+{
+  void (*job)(void);
+  uint32_t posted; // cycle count when posted
+} sporadicJob_t;
+typedef struct
+{
+  uint32_t time;   // OS time when the cycles come back
+  uint32_t amount; // cycles to give back
+} sporadicRepl_t;
+static sporadicJob_t SporadicJobs[SPORADIC_QUEUESIZE];
+static uint32_t SporadicPutI, SporadicGetI, SporadicCount;
+static sporadicRepl_t SporadicRepl[SPORADIC_REPLSIZE];
+static uint32_t SporadicReplCount;
+static int32_t SporadicCapacity; // cycles left, negative while paying back an overrun
+static uint32_t SporadicPeriod;
+static uint32_t SporadicMaxResponse, SporadicDropped;
+#if OS_CYCLIC
+// cyclic executive, bit i of a frame is set if event_tasks[i] is released in it
+#if NUMPERIODIC <= 8
+typedef uint8_t frameMask_t;
+#elif NUMPERIODIC <= 16
+typedef uint16_t frameMask_t;
+#elif NUMPERIODIC <= 32
+typedef uint32_t frameMask_t;
+#else
+#error "OS_CYCLIC frame masks hold at most 32 periodic event threads, lower NUMPERIODIC"
+#endif
+static frameMask_t FrameTable[CYCLIC_MAXFRAMES];
+static uint32_t FrameTicks; // ticks per frame
+static uint32_t NumFrames;  // frames per hyperperiod
+static uint32_t FrameI;     // next frame to dispatch
+static uint32_t FrameCount; // ticks left in this frame
+static void runframes(void);
+#endif
 // ******** OS_Init ************
 // Initialize operating system, disable interrupts
 // Initialize OS controlled I/O: systick, bus clock as fast as possible
@@ -28,24 +102,76 @@ void OS_Init(void)
   DisableInterrupts();
   BSP_Clock_InitFastest(); // set processor clock to fastest speed
   uint8_t i;
-  for (i = 0; i < NUMTHREADS; i++)
+  for (i = 0; i < NUMTHREADS + 1; i++)
   {
     tcbs[i].blocked = NULL;
     tcbs[i].next = NULL;
     tcbs[i].sp = NULL;
     tcbs[i].sleep = 0;
+    tcbs[i].task = NULL;
+    tcbs[i].quantum = 0;
+    tcbs[i].budget = 0;
+    tcbs[i].budgetPeriod = 0;
+    tcbs[i].budgetNext = 0;
+    tcbs[i].used = 0;
+    tcbs[i].priority = DEFAULT_PRIORITY;
+    tcbs[i].wokenAt = 0;
+    tcbs[i].blockedAt = 0;
+    tcbs[i].timedOut = 0;
   }
+  for (i = 0; i < NUMSEMSTATS; i++)
+  {
+    SemStats[i].sema = NULL;
+  }
+  NumThreads = 0;
 
   for (i = 0; i < NUMPERIODIC; i++)
   {
     event_tasks[i].PeriodicEventTask = NULL;
     event_tasks[i].TaskPeriod = 0;
-    event_tasks[i].TaskCounter = 0;
+    event_tasks[i].NextRelease = 0;
+    event_tasks[i].Policy = OVERRUN_SKIP;
+    event_tasks[i].Overruns = 0;
+    event_tasks[i].MaxLateness = 0;
+    event_tasks[i].Phase = 0;
+    event_tasks[i].Realign = 0;
+    event_tasks[i].Rearmed = 0;
   }
+  PausedSet = 0;
+  DEMCR |= 0x01000000; // enable the DWT cycle counter
+  DWTCYCCNT = 0;
+  DWTCTRL |= 0x00000001;
+  CyclesPerTick = BSP_Clock_GetFreq() / TIMER_FREQ;
+  OSTime = 0;
+  OSTimeWraps = 0;
+  TickSynced = 0;
   RunPt = NULL;
+  USleepPt = NULL;
+  SetInitialStack(NUMTHREADS);
+  Stacks[NUMTHREADS][STACKSIZE - 2] = (int32_t)(idlethread); // PC
+  IdlePt->task = idlethread;
+  IdlePt->priority = IDLE_PRIORITY;
+  LoadTicks = 0;
+  LoadIdle = 0;
+  CpuLoad = 0;
+  LoadSamples = 0;
+#if OS_CYCLIC
+  BSP_PeriodicTask_Init(&runframes, TIMER_FREQ, TIMER_PRIORITY);
+#else
   BSP_PeriodicTask_Init(&runperiodicevents, TIMER_FREQ, TIMER_PRIORITY);
+#endif
+  BSP_OneShotTask_Init(&wakeusleeper, ONESHOT_PRIORITY);
 }
 
+// the idle thread, sleeps the processor until the next interrupt;
+// the scheduler runs it only when no main thread is ready
+static void idlethread(void)
+{
+  while (1)
+  {
+    WaitForInterrupt();
+  }
+}
 void SetInitialStack(int i)
 {
   tcbs[i].sp = &Stacks[i][STACKSIZE - 16];
@@ -66,31 +192,121 @@ void SetInitialStack(int i)
   Stacks[i][STACKSIZE - 16] = R4;  // R4
 }
 
+//******** OS_AddThread ***************
+// Add one main thread to the scheduler
+// Inputs: function pointer to a void/void main thread
+// Outputs: 1 if successful, 0 if this thread can not be added
+// This function will only be called after OS_Init and before OS_Launch
+int OS_AddThread(void (*thread)(void))
+{
+  long crit = OS_StartCritical();
+  uint8_t i = NumThreads;
+  if (i >= NUMTHREADS)
+  {
+    OS_EndCritical(crit);
+    return 0;
+  }
+  SetInitialStack(i);
+  Stacks[i][STACKSIZE - 2] = (int32_t)(thread); // PC
+  tcbs[i].task = thread;
+  // insert at the end of the TCB circular list
+  tcbs[i].next = &tcbs[0];
+  if (i > 0)
+  {
+    tcbs[i - 1].next = &tcbs[i];
+  }
+  else
+  {
+    RunPt = &tcbs[0]; // first thread added runs first
+  }
+  NumThreads++;
+  OS_EndCritical(crit);
+  return 1; // successful
+}
+
 //******** OS_AddThreads ***************
-// Add four main threads to the scheduler
-// Inputs: function pointers to four void/void main threads
+// Add two main threads to the scheduler
+// Inputs: function pointers to two void/void main threads
 // Outputs: 1 if successful, 0 if this thread can not be added
 // This function will only be called once, after OS_Init and before OS_Launch
 int OS_AddThreads(void (*thread0)(void), void (*thread1)(void))
 {
-  uint32_t crit = StartCritical();
-  // initialize TCB circular list
-  tcbs[0].next = &tcbs[1];
-  tcbs[1].next = &tcbs[0];
+  return OS_AddThread(thread0) && OS_AddThread(thread1);
+}
 
-  for (uint8_t i = 0; i < NUMTHREADS; i++)
+// TCB of a main thread, NULL if not found
+static tcbType *findthread(void (*thread)(void))
+{
+  uint8_t i;
+  for (i = 0; i < NumThreads; i++)
   {
-    SetInitialStack(i);
+    if (tcbs[i].task == thread)
+    {
+      return &tcbs[i];
+    }
   }
+  return NULL;
+}
 
-  Stacks[0][STACKSIZE - 2] = (int32_t)(thread0);
-  Stacks[1][STACKSIZE - 2] = (int32_t)(thread1);
+//******** OS_SetPriority ***************
+// Set the priority of a main thread (default DEFAULT_PRIORITY)
+// The scheduler always runs the highest priority ready thread;
+// threads of equal priority share the CPU round robin
+// Inputs: the main thread, as passed to OS_AddThread
+//         priority 0 (highest) to 254
+// Outputs: 1 if successful, 0 if thread is not a main thread
+int OS_SetPriority(void (*thread)(void), uint32_t priority)
+{
+  tcbType *pt = findthread(thread);
+  if ((pt == NULL) || (priority > 254))
+  {
+    return 0;
+  }
+  pt->priority = priority;
+  return 1;
+}
 
-  // initialize RunPt
-  RunPt = &tcbs[0];
+//******** OS_SetQuantum ***************
+// Give a main thread its own time slice
+// Inputs: the main thread, as passed to OS_AddThread
+//         number of clock cycles for its time slice, 0 for the OS_Launch value
+// Outputs: 1 if successful, 0 if thread is not a main thread
+// Errors: theTimeSlice must be less than 16,777,216
+int OS_SetQuantum(void (*thread)(void), uint32_t theTimeSlice)
+{
+  tcbType *pt = findthread(thread);
+  if ((pt == NULL) || (theTimeSlice > 0x00FFFFFF))
+  {
+    return 0;
+  }
+  pt->quantum = theTimeSlice;
+  return 1;
+}
 
-  EndCritical(crit);
-  return 1; // successful
+//******** OS_SetBudget ***************
+// Reserve a share of the CPU for a main thread
+// The thread may run for at most budget clock cycles in every
+// period ticks; once it is used up the thread only runs when
+// no other main thread is ready, until its budget is replenished
+// Inputs: the main thread, as passed to OS_AddThread
+//         budget in clock cycles, 0 removes the limit
+//         replenish period in ticks (msec)
+// Outputs: 1 if successful, 0 if thread is not a main thread
+int OS_SetBudget(void (*thread)(void), uint32_t budget, uint32_t period)
+{
+  tcbType *pt = findthread(thread);
+  long crit;
+  if ((pt == NULL) || ((budget > 0) && (period == 0)))
+  {
+    return 0;
+  }
+  crit = OS_StartCritical();
+  pt->budget = budget;
+  pt->budgetPeriod = period;
+  pt->budgetNext = OSTime + period;
+  pt->used = 0;
+  OS_EndCritical(crit);
+  return 1;
 }
 
 //******** OS_AddPeriodicEventThreads ***************
@@ -105,44 +321,695 @@ int OS_AddThreads(void (*thread0)(void), void (*thread1)(void))
 // These threads can call OS_Signal
 int OS_AddPeriodicEventThread(void (*thread)(void), uint32_t period)
 {
-  uint16_t cr = StartCritical();
+  long crit = OS_StartCritical();
   static uint8_t itr = 0;
-  if (itr < NUMPERIODIC)
+  if ((itr < NUMPERIODIC) && (period > 0))
   {
-    if (event_tasks[itr].PeriodicEventTask == NULL)
+    event_tasks[itr].PeriodicEventTask = thread;
+    event_tasks[itr].TaskPeriod = period;
+    event_tasks[itr].NextRelease = OSTime + period;
+    itr++;
+    OS_EndCritical(crit);
+    return 1;
+  }
+  OS_EndCritical(crit);
+  return 0;
+}
+// run a high rate event thread and track its release jitter
+static void runhwtask(hwTask_t *hw)
+{
+  uint32_t now = DWTCYCCNT;
+  uint32_t gap, dev;
+  if (hw->last)
+  {
+    gap = now - hw->last;
+    dev = (gap > hw->period) ? gap - hw->period : hw->period - gap;
+    if (dev > hw->jitter)
     {
-      event_tasks[itr].PeriodicEventTask = thread;
-      event_tasks[itr].TaskPeriod = period;
-      event_tasks[itr].TaskCounter = period;
-      itr++;
+      hw->jitter = dev;
     }
-    EndCritical(cr);
-    return 1;
+  }
+  hw->last = now | 1;
+  hw->task();
+}
+static void runhwtaskB(void)
+{
+  runhwtask(&HWTaskB);
+}
+static void runhwtaskC(void)
+{
+  runhwtask(&HWTaskC);
+}
+//******** OS_AddHighRateEventThread ***************
+// Add a periodic event thread with its own hardware timer, for
+// threads that run faster than the tick or cannot stand a tick of
+// release jitter; the first one gets Wide Timer 4A, the second
+// Wide Timer 3A, each with its own interrupt priority
+// Inputs: pointer to a void/void event thread function
+//         freq is releases per second, 1 Hz to 10 kHz
+//         priority is the NVIC priority KERNEL_BASEPRI to 7; the
+//         timer driver runs 7 at 6, above the SysTick scheduler
+// Outputs: 1 if successful, 0 if
+//          freq is 0 or above 10 kHz,
+//          priority is below KERNEL_BASEPRI (the thread may call the OS,
+//          so the kernel must be able to mask it) or above 7, or
+//          both timers are in use
+// The same rules as OS_AddPeriodicEventThread apply to the thread
+int OS_AddHighRateEventThread(void (*thread)(void), uint32_t freq, uint8_t priority)
+{
+  hwTask_t *hw;
+  if ((freq == 0) || (freq > 10000) || (priority < KERNEL_BASEPRI) || (priority > 7))
+  {
+    return 0;
+  }
+  hw = (HWTaskB.task == NULL) ? &HWTaskB : (HWTaskC.task == NULL) ? &HWTaskC : NULL;
+  if (hw == NULL)
+  {
+    return 0;
+  }
+  hw->task = thread;
+  hw->period = BSP_Clock_GetFreq() / freq;
+  hw->last = 0;
+  hw->jitter = 0;
+  if (hw == &HWTaskB)
+  {
+    BSP_PeriodicTask_InitB(&runhwtaskB, freq, priority);
   }
   else
+  {
+    BSP_PeriodicTask_InitC(&runhwtaskC, freq, priority);
+  }
+  return 1;
+}
+//******** OS_GetReleaseJitter ***************
+// Worst release jitter of a high rate event thread, the largest
+// difference between the time between two releases and its period
+// Inputs: the event thread, as passed to OS_AddHighRateEventThread
+// Outputs: jitter in clock cycles, 0 if thread is not a high rate thread
+uint32_t OS_GetReleaseJitter(void (*thread)(void))
+{
+  if (HWTaskB.task == thread)
+  {
+    return HWTaskB.jitter;
+  }
+  if (HWTaskC.task == thread)
+  {
+    return HWTaskC.jitter;
+  }
+  return 0;
+}
+// index of a periodic event thread in event_tasks, -1 if not found
+static int findperiodic(void (*thread)(void))
+{
+  int i;
+  for (i = 0; i < NUMPERIODIC; i++)
+  {
+    if (event_tasks[i].PeriodicEventTask == thread)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+//******** OS_SetOverrunPolicy ***************
+// Choose how a periodic event thread recovers when a load spike
+// delays it by a period or more (default OVERRUN_SKIP)
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+//         policy OVERRUN_SKIP, OVERRUN_CATCHUP or OVERRUN_RESYNC
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+int OS_SetOverrunPolicy(void (*thread)(void), OverrunPolicy policy)
+{
+  int i = findperiodic(thread);
+  if (i < 0)
+  {
+    return 0;
+  }
+  event_tasks[i].Policy = policy;
+  return 1;
+}
+//******** OS_GetOverruns ***************
+// Number of releases of a periodic event thread that did not
+// start within their own period
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+// Outputs: overrun count, 0 if thread is not a periodic event thread
+uint32_t OS_GetOverruns(void (*thread)(void))
+{
+  int i = findperiodic(thread);
+  return (i < 0) ? 0 : event_tasks[i].Overruns;
+}
+//******** OS_GetMaxLateness ***************
+// Worst lateness of any release of a periodic event thread
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+// Outputs: lateness in ticks (msec), 0 if thread is not a periodic event thread
+uint32_t OS_GetMaxLateness(void (*thread)(void))
+{
+  int i = findperiodic(thread);
+  return (i < 0) ? 0 : event_tasks[i].MaxLateness;
+}
+// event_tasks entry of a thread whose schedule may be changed, NULL if none
+static eventTaskPt changeable(void (*thread)(void))
+{
+  int i;
+  if (OS_CYCLIC)
+  {
+    return NULL; // frame table is fixed at launch
+  }
+  i = findperiodic(thread);
+  return (i < 0) ? NULL : &event_tasks[i];
+}
+//******** OS_SetPeriod ***************
+// Change the period of a periodic event thread while running
+// The release already pending is kept; the new period applies
+// from it onwards, so no release is doubled or skipped
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+//         new period in ticks (msec)
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+// Not supported with OS_CYCLIC (returns 0)
+int OS_SetPeriod(void (*thread)(void), uint32_t period)
+{
+  eventTaskPt task = changeable(thread);
+  long crit;
+  if ((task == NULL) || (period == 0))
+  {
     return 0;
+  }
+  crit = OS_StartCritical();
+  task->TaskPeriod = period;
+  OS_EndCritical(crit);
+  return 1;
 }
-void static runperiodicevents(void)
+//******** OS_SetPhase ***************
+// Align the releases of a periodic event thread to OS time
+// After the pending release, releases move to the times t with
+// (t - phase) a multiple of the period; the release after the
+// pending one is the first such time, so none is doubled or skipped.
+// t counts ticks since OS_Init without wrapping, so threads keep
+// their relative phases when OS time passes 2^32 ms (49.7 days)
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+//         phase in ticks (msec), taken modulo the period
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+// Not supported with OS_CYCLIC (returns 0)
+int OS_SetPhase(void (*thread)(void), uint32_t phase)
+{
+  eventTaskPt task = changeable(thread);
+  long crit;
+  if (task == NULL)
+  {
+    return 0;
+  }
+  crit = OS_StartCritical();
+  task->Phase = phase;
+  task->Realign = 1;
+  OS_EndCritical(crit);
+  return 1;
+}
+//******** OS_PauseTask ***************
+// Stop releasing a periodic event thread
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+// Not supported with OS_CYCLIC (returns 0)
+int OS_PauseTask(void (*thread)(void))
+{
+  eventTaskPt task = changeable(thread);
+  if (task == NULL)
+  {
+    return 0;
+  }
+  Flag_Set(PausedSet, task - event_tasks); // runperiodicevents sees it at its next tick
+  return 1;
+}
+//******** OS_ResumeTask ***************
+// Release a paused periodic event thread again, on its old
+// schedule; releases that fell due while paused are dropped
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+// Not supported with OS_CYCLIC (returns 0)
+int OS_ResumeTask(void (*thread)(void))
+{
+  eventTaskPt task = changeable(thread);
+  uint32_t behind;
+  long crit;
+  if (task == NULL)
+  {
+    return 0;
+  }
+  crit = OS_StartCritical();
+  if (Flag_Test(PausedSet, task - event_tasks) && ((int32_t)(OSTime - task->NextRelease) >= 0))
+  { // skip to the first release on the old schedule that is still ahead
+    behind = OSTime - task->NextRelease;
+    task->NextRelease += (behind / task->TaskPeriod + 1) * task->TaskPeriod;
+  }
+  Flag_Clear(PausedSet, task - event_tasks);
+  OS_EndCritical(crit);
+  return 1;
+}
+//******** OS_ReleaseIn ***************
+// Set the next release of a periodic event thread to a number of
+// ticks from now, in place of the one its period would give; a
+// thread that calls this on itself every run is a one-shot timer
+// that runs only when it has work, at times it chooses
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+//         delay in ticks (msec), 0 for the next tick
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+// Not supported with OS_CYCLIC (returns 0); there a thread that times
+// itself this way must run from a fixed slot and check what is due
+int OS_ReleaseIn(void (*thread)(void), uint32_t delay)
+{
+  eventTaskPt task = changeable(thread);
+  long crit;
+  if (task == NULL)
+  {
+    return 0;
+  }
+  crit = OS_StartCritical();
+  task->NextRelease = OSTime + delay;
+  task->Rearmed = 1;
+  OS_EndCritical(crit);
+  return 1;
+}
+//******** OS_Time ***************
+// Number of ticks since OS_Init, counting ticks that were
+// missed because the tick interrupt was held off
+// Inputs: none
+// Outputs: time in ticks (msec)
+uint32_t OS_Time(void)
+{
+  return OSTime;
+}
+//******** OS_CpuLoad ***************
+// Share of the processor used by everything except the idle
+// thread, averaged over about the last 8 load windows
+// Inputs: none
+// Outputs: load in 0.1% units, 0 to 1000
+// Not supported with OS_CYCLIC (returns 0)
+uint32_t OS_CpuLoad(void)
+{
+  return CpuLoad;
+}
+// release one periodic event thread that is due, then pick its
+// next release according to its overrun policy
+static void releaseperiodic(eventTaskPt task)
+{
+  uint32_t late = OSTime - task->NextRelease;
+  uint32_t missed = late / task->TaskPeriod; // whole periods behind
+  uint32_t into;                             // ticks since OS_Init, modulo the period
+  if (late > task->MaxLateness)
+  {
+    task->MaxLateness = late;
+  }
+  task->Rearmed = 0;
+  task->PeriodicEventTask();
+  if (task->Rearmed)
+  { // the thread picked its own next release
+    return;
+  }
+  switch (task->Policy)
+  {
+  case OVERRUN_CATCHUP: // still due on the next tick if we are behind
+    if (missed)
+    {
+      task->Overruns++;
+    }
+    task->NextRelease += task->TaskPeriod;
+    break;
+  case OVERRUN_RESYNC: // phase moves by however late we were
+    task->Overruns += missed;
+    task->NextRelease = OSTime + task->TaskPeriod;
+    break;
+  case OVERRUN_SKIP:
+  default: // this run stands in for the latest missed release
+    task->Overruns += missed;
+    task->NextRelease += (missed + 1) * task->TaskPeriod;
+    break;
+  }
+  if (task->Realign)
+  { // first time after now that is phase plus a multiple of the period,
+    // on the 64-bit tick count so the grid does not jump when OSTime wraps
+    into = (((uint64_t)OSTimeWraps << 32) | OSTime) % task->TaskPeriod;
+    task->NextRelease = OSTime + task->TaskPeriod -
+                        (into + task->TaskPeriod - task->Phase % task->TaskPeriod) % task->TaskPeriod;
+    task->Realign = 0;
+  }
+}
+// give back sporadic server cycles whose replenish time has come
+static void sporadicreplenish(void)
+{
+  uint32_t i, j;
+  if (SporadicReplCount == 0)
+  {
+    return;
+  }
+  for (i = 0, j = 0; i < SporadicReplCount; i++)
+  {
+    if ((int32_t)(OSTime - SporadicRepl[i].time) >= 0)
+    {
+      SporadicCapacity += SporadicRepl[i].amount;
+    }
+    else
+    {
+      SporadicRepl[j++] = SporadicRepl[i]; // keep, in time order
+    }
+  }
+  SporadicReplCount = j;
+  if ((SporadicCount > 0) && (SporadicCapacity > 0))
+  {
+    INTCTRL = 0x10000000; // trigger PendSV to run the waiting jobs
+  }
+}
+// count down a sleeping thread by elapsed ticks; a thread that is
+// also blocked is in OS_WaitTimeout and gives up on the semaphore
+// called with interrupts disabled
+static void countdown(tcbType *pt, uint32_t elapsed)
+{
+  OS_SemStats_t *st;
+  if (pt->sleep > (int32_t)elapsed)
+  {
+    pt->sleep -= elapsed;
+    return;
+  }
+  pt->sleep = 0;
+  if (pt->blocked != NULL)
+  { // timed out, return the count OS_WaitTimeout took
+    (*pt->blocked) = (*pt->blocked) + 1;
+    st = findstats(pt->blocked);
+    if (st != NULL)
+    {
+      st->timeouts++;
+    }
+    chargeblocked(st, pt);
+    pt->blocked = NULL;
+    pt->timedOut = 1;
+  }
+  if (RunPt == IdlePt)
+  {
+    OS_Suspend(); // a thread is ready, leave the idle thread now
+  }
+}
+// once per load window, sample the idle thread's share of the window
+static void sampleload(uint32_t elapsed)
+{
+  uint32_t now, idle, window, load;
+  LoadTicks += elapsed;
+  if (LoadTicks < LOAD_WINDOW)
+  {
+    return;
+  }
+  LoadTicks = 0;
+  now = DWTCYCCNT;
+  idle = IdlePt->used;
+  if (RunPt == IdlePt)
+  { // add the part of the current idle slice not yet charged
+    idle += now - SliceStart;
+  }
+  window = now - LoadStart;
+  idle -= LoadIdle;
+  LoadIdle += idle;
+  LoadStart = now;
+  if (idle > window)
+  {
+    idle = window;
+  }
+  load = (window - idle) / (window / 1000 + 1);
+  if (LoadSamples < 8)
+  { // average the first samples so the figure starts out right
+    LoadSamples++;
+    CpuLoad = (CpuLoad * (LoadSamples - 1) + load) / LoadSamples;
+  }
+  else
+  {
+    CpuLoad = (CpuLoad * 7 + load) / 8;
+  }
+}
+static void runperiodicevents(void)
 {
   // **RUN PERIODIC THREADS, DECREMENT SLEEP COUNTERS
   uint8_t i;
+  uint32_t elapsed; // ticks since last run, more than 1 if this interrupt was held off
+  if (!TickSynced)
+  { // first tick after launch fixes the phase; time spent before launch is not counted
+    LastTick = DWTCYCCNT - CyclesPerTick;
+    TickSynced = 1;
+    LoadStart = DWTCYCCNT;
+    LoadIdle = IdlePt->used;
+  }
+  elapsed = (DWTCYCCNT - LastTick + CyclesPerTick / 2) / CyclesPerTick;
+  if (elapsed == 0)
+  {
+    elapsed = 1;
+  }
+  LastTick += elapsed * CyclesPerTick;
+  OSTime += elapsed;
+  if (OSTime < elapsed)
+  {
+    OSTimeWraps++;
+  }
+  sampleload(elapsed);
   for (i = 0; i < NUMTHREADS; i++)
   {
     if (tcbs[i].sleep > 0)
     {
-      tcbs[i].sleep--;
+      countdown(&tcbs[i], elapsed);
+    }
+  }
+  for (i = 0; i < NumThreads; i++)
+  { // replenish CPU budgets
+    if (tcbs[i].budget && ((int32_t)(OSTime - tcbs[i].budgetNext) >= 0))
+    {
+      tcbs[i].used = 0;
+      tcbs[i].budgetNext += tcbs[i].budgetPeriod;
+      if ((int32_t)(OSTime - tcbs[i].budgetNext) >= 0)
+      { // more than a period behind, restart the period from now
+        tcbs[i].budgetNext = OSTime + tcbs[i].budgetPeriod;
+      }
     }
   }
+  sporadicreplenish();
   for (i = 0; i < NUMPERIODIC; i++)
   { // Run periodic event threads
-    event_tasks[i].TaskCounter = event_tasks[i].TaskCounter--;
-    if (event_tasks[i].TaskCounter == 0)
+    if ((event_tasks[i].PeriodicEventTask != NULL) && !Flag_Test(PausedSet, i) &&
+        ((int32_t)(OSTime - event_tasks[i].NextRelease) >= 0))
+    {
+      releaseperiodic(&event_tasks[i]);
+    }
+  }
+}
+// ******** OS_Sporadic_Init ************
+// Start the sporadic server that runs aperiodic jobs
+// Jobs run to completion in the PendSV handler, above all main
+// threads and at the priority of the periodic event threads, using
+// at most budget clock cycles in any window of period ticks
+// Each cycle consumed is given back period ticks after the server
+// started the job that consumed it
+// Inputs:  budget in clock cycles
+//          replenish period in ticks (msec)
+// Outputs: 1 if successful, 0 if the parameters are invalid
+// Called after OS_Init and before OS_Launch
+int OS_Sporadic_Init(uint32_t budget, uint32_t period)
+{
+  long crit;
+  if ((budget == 0) || (budget > 0x7FFFFFFF) || (period == 0))
+  {
+    return 0;
+  }
+  crit = OS_StartCritical();
+  SporadicPeriod = period;
+  SporadicCapacity = budget;
+  SporadicPutI = SporadicGetI = SporadicCount = 0;
+  SporadicReplCount = 0;
+  SporadicMaxResponse = 0;
+  SporadicDropped = 0;
+  SYSPRI3 = (SYSPRI3 & 0xFF00FFFF) | (SPORADIC_PRIORITY << 21); // PendSV priority
+  OS_EndCritical(crit);
+  return 1;
+}
+
+// ******** OS_Sporadic_Post ************
+// Queue an aperiodic job for the sporadic server
+// May be called from main threads, event threads or interrupts
+// Inputs:  void/void job that runs to completion; it cannot
+//          spin, block, loop, sleep, or kill
+// Outputs: 1 if queued, 0 if the queue is full (job dropped)
+int OS_Sporadic_Post(void (*job)(void))
+{
+  long crit = OS_StartCritical();
+  if (SporadicCount >= SPORADIC_QUEUESIZE)
+  {
+    SporadicDropped++;
+    OS_EndCritical(crit);
+    return 0;
+  }
+  SporadicJobs[SporadicPutI].job = job;
+  SporadicJobs[SporadicPutI].posted = DWTCYCCNT;
+  SporadicPutI = (SporadicPutI + 1) % SPORADIC_QUEUESIZE;
+  SporadicCount++;
+  if (SporadicCapacity > 0)
+  {
+    INTCTRL = 0x10000000; // trigger PendSV
+  }
+  OS_EndCritical(crit);
+  return 1;
+}
+
+// ******** OS_Sporadic_MaxResponse ************
+// Worst response time seen so far, from OS_Sporadic_Post
+// until the job returned
+// Inputs:  none
+// Outputs: time in clock cycles
+uint32_t OS_Sporadic_MaxResponse(void)
+{
+  return SporadicMaxResponse;
+}
+
+// ******** OS_Sporadic_Dropped ************
+// Number of jobs lost because the sporadic queue was full
+// Inputs:  none
+// Outputs: count
+uint32_t OS_Sporadic_Dropped(void)
+{
+  return SporadicDropped;
+}
+
+// the sporadic server, runs queued jobs while it has capacity
+// jobs run to completion, so the last one may overdraw the capacity;
+// the overdraft is paid back out of the next replenishment
+void PendSV_Handler(void)
+{
+  sporadicJob_t j;
+  uint32_t start, used, response, began;
+  long crit;
+  while (1)
+  {
+    crit = OS_StartCritical();
+    if ((SporadicCount == 0) || (SporadicCapacity <= 0))
+    {
+      OS_EndCritical(crit);
+      return; // sporadicreplenish triggers PendSV again when capacity returns
+    }
+    j = SporadicJobs[SporadicGetI];
+    SporadicGetI = (SporadicGetI + 1) % SPORADIC_QUEUESIZE;
+    SporadicCount--;
+    OS_EndCritical(crit);
+    began = OSTime;
+    start = DWTCYCCNT;
+    j.job();
+    used = DWTCYCCNT - start;
+    response = DWTCYCCNT - j.posted;
+    crit = OS_StartCritical();
+    SporadicCapacity -= used;
+    if (SporadicReplCount < SPORADIC_REPLSIZE)
+    {
+      SporadicRepl[SporadicReplCount].time = began + SporadicPeriod;
+      SporadicRepl[SporadicReplCount].amount = used;
+      SporadicReplCount++;
+    }
+    else
+    { // table full, fold into the latest entry (returns later, never early)
+      SporadicRepl[SPORADIC_REPLSIZE - 1].time = began + SporadicPeriod;
+      SporadicRepl[SPORADIC_REPLSIZE - 1].amount += used;
+    }
+    if (response > SporadicMaxResponse)
+    {
+      SporadicMaxResponse = response;
+    }
+    OS_EndCritical(crit);
+  }
+}
+
+// time slice for a thread, never longer than what is left of its budget
+static uint32_t slicefor(tcbType *pt)
+{
+  uint32_t slice = pt->quantum ? pt->quantum : TimeSlice;
+  if (pt->budget && (pt->budget > pt->used) && (pt->budget - pt->used < slice))
+  {
+    slice = pt->budget - pt->used;
+  }
+  return slice;
+}
+#if OS_CYCLIC
+static uint32_t gcd32(uint32_t a, uint32_t b)
+{
+  uint32_t t;
+  while (b)
+  {
+    t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+// lay the periodic event threads out over one hyperperiod
+// Outputs: 1 if successful, 0 if the table would not fit
+static int buildframetable(void)
+{
+  uint32_t hyper = 1, frame = 0, t, k;
+  uint8_t i;
+  frameMask_t mask;
+  for (i = 0; i < NUMPERIODIC; i++)
+  {
+    if (event_tasks[i].PeriodicEventTask != NULL)
+    {
+      t = event_tasks[i].TaskPeriod;
+      frame = gcd32(frame, t);
+      hyper = hyper / gcd32(hyper, t) * t;
+      if (hyper / frame > CYCLIC_MAXFRAMES)
+      {
+        return 0;
+      }
+    }
+  }
+  if (frame == 0)
+  { // no event threads, idle frames of one tick
+    frame = 1;
+  }
+  FrameTicks = frame;
+  NumFrames = hyper / frame;
+  for (k = 0; k < NumFrames; k++)
+  { // frame k ends at (k+1)*frame, when the releases fall due
+    mask = 0;
+    for (i = 0; i < NUMPERIODIC; i++)
+    {
+      if ((event_tasks[i].PeriodicEventTask != NULL) &&
+          (((k + 1) * frame) % event_tasks[i].TaskPeriod == 0))
+      {
+        mask |= (frameMask_t)1 << i;
+      }
+    }
+    FrameTable[k] = mask;
+  }
+  FrameI = 0;
+  FrameCount = FrameTicks;
+  return 1;
+}
+// cyclic executive tick, dispatches a frame from the table at each frame boundary
+static void runframes(void)
+{
+  uint8_t i;
+  frameMask_t mask;
+  if (++OSTime == 0)
+  {
+    OSTimeWraps++;
+  }
+  if ((RunPt != NULL) && (RunPt->sleep > 0))
+  {
+    countdown(RunPt, 1);
+  }
+  sporadicreplenish();
+  if (--FrameCount)
+  {
+    return;
+  }
+  FrameCount = FrameTicks;
+  mask = FrameTable[FrameI];
+  FrameI = (FrameI + 1 == NumFrames) ? 0 : FrameI + 1;
+  for (i = 0; mask; i++, mask >>= 1)
+  {
+    if (mask & 1)
     {
       event_tasks[i].PeriodicEventTask();
-      event_tasks[i].TaskCounter = event_tasks[i].TaskPeriod;
     }
   }
 }
+#endif
 //******** OS_Launch ***************
 // Start the scheduler, enable interrupts
 // Inputs: number of clock cycles for each time slice
@@ -150,21 +1017,114 @@ void static runperiodicevents(void)
 // Errors: theTimeSlice must be less than 16,777,216
 void OS_Launch(uint32_t theTimeSlice)
 {
+#if OS_CYCLIC
+  if (!buildframetable())
+  {
+    while (1)
+    {
+    } // hyperperiod too long for CYCLIC_MAXFRAMES
+  }
+  EnableInterrupts();
+  if (RunPt != NULL)
+  {
+    RunPt->task(); // background loop, does not return
+  }
+  while (1)
+  {
+    WaitForInterrupt();
+  }
+#else
   STCTRL = 0;                                    // disable SysTick during setup
   STCURRENT = 0;                                 // any write to current clears it
   SYSPRI3 = (SYSPRI3 & 0x00FFFFFF) | 0xE0000000; // priority 7
-  STRELOAD = theTimeSlice - 1;                   // reload value
+  TimeSlice = theTimeSlice;                      // default for threads without a quantum
+  if (RunPt == NULL)
+  { // no main threads, only the idle thread runs
+    RunPt = IdlePt;
+  }
+  STRELOAD = slicefor(RunPt) - 1;                // reload value
   STCTRL = 0x00000007;                           // enable, core clock and interrupt arm
+  SliceStart = DWTCYCCNT;
   StartOS();                                     // start on the first task
+#endif
 }
-// runs every ms
-void Scheduler(void) // every time slice
+// nonzero if the thread has used up its CPU budget
+#define overbudget(pt) ((pt)->budget && ((pt)->used >= (pt)->budget))
+// highest priority ready thread, searching the ring after pt so that
+// equal priorities take turns; with budgets set, threads over budget are
+// only picked when nothing within budget is ready
+static tcbType *pickthread(tcbType *pt, int budgets)
 {
-  RunPt = RunPt->next; // ROUND ROBIN, skip blocked and sleeping threads
-  while (RunPt->blocked || RunPt->sleep)
+  tcbType *best = NULL;
+  uint8_t n;
+  for (n = 0; n < NumThreads; n++)
   {
-    RunPt = RunPt->next;
+    pt = pt->next;
+    if (!pt->blocked && !pt->sleep && !(budgets && overbudget(pt)) &&
+        ((best == NULL) || (pt->priority < best->priority)))
+    {
+      best = pt;
+    }
+  }
+  if ((best == NULL) && budgets)
+  { // nothing within budget is ready, let a throttled thread use the idle time
+    return pickthread(pt, 0);
+  }
+  return best;
+}
+// runs at the end of every time slice
+void Scheduler(void)
+{
+  tcbType *pt;
+  uint32_t now = DWTCYCCNT;
+  RunPt->used += now - SliceStart; // charge the thread that was running
+  // highest priority first, ROUND ROBIN among equals,
+  // skip blocked and sleeping threads and threads over budget,
+  // run the idle thread if none is left
+  pt = pickthread(RunPt, 1);
+  if (pt == NULL)
+  { // nothing is ready, e.g. the only thread is in OS_SleepUs;
+    // never search the ring for a ready thread that is not there,
+    // idle until an interrupt wakes a thread
+    if (RunPt != IdlePt)
+    {
+      IdlePt->next = RunPt->next; // the next search starts where this one left off
+    }
+    pt = IdlePt;
+  }
+  RunPt = pt;
+  if (RunPt->wokenAt)
+  { // first switch in since OS_Signal woke it
+    if (now - RunPt->wokenAt > MaxSignalLatency)
+    {
+      MaxSignalLatency = now - RunPt->wokenAt;
+    }
+    RunPt->wokenAt = 0;
+  }
+  STRELOAD = slicefor(RunPt) - 1; // takes effect on the reload below
+  STCURRENT = 0;                  // any write to current clears it
+  SliceStart = now;
+}
+// ******** OS_Suspend ************
+// Abandon current thread, go to next one
+// Inputs:  none
+// Outputs: none
+void OS_Suspend(void)
+{
+#if OS_CYCLIC
+  if (INTCTRL & 0x000001FF)
+  { // handler mode (VECTACTIVE set), there is no thread to switch to;
+    // the background loop sees the change when the handler returns
+    return;
+  }
+  while (RunPt->sleep || RunPt->blocked)
+  { // only the background loop runs, wait for it to be ready again
+    WaitForInterrupt();
   }
+#else
+  STCURRENT = 0;        // any write to current clears it
+  INTCTRL = 0x04000000; // trigger SysTick
+#endif
 }
 // ******** OS_Sleep ************
 // place this thread into a dormant state
@@ -173,9 +1133,80 @@ void Scheduler(void) // every time slice
 // OS_Sleep(0) implements cooperative multitasking
 void OS_Sleep(uint32_t sleepTime)
 {
-  // ****IMPLEMENT THIS****
   RunPt->sleep = sleepTime; // set sleep parameter in TCB, same as Lab 3
-  //OS_Suspend();             // suspend, stops running.
+  OS_Suspend();             // suspend, stops running.
+}
+// ******** OS_SleepUs ************
+// place this thread into a dormant state for a short time
+// Sleeps shorter than one tick use the one-shot timer and wake
+// exactly this thread after us microseconds, no rounding. One
+// thread at a time may own the one-shot; a short sleep asked for
+// while it is busy sleeps until the next tick instead.
+// Sleeps of one tick or longer are rounded up to whole ticks and
+// go through the tick list like OS_Sleep.
+// OS_SleepUs(0) behaves like OS_Sleep(0) and only gives up the slice.
+// If every main thread is asleep the idle thread runs until the
+// one-shot or the tick wakes one.
+// Lab2 has no caller; this is API for drivers that must wait less
+// than a tick, such as a sensor conversion or an LCD reset pulse.
+// input:  number of usec to sleep
+// output: none
+void OS_SleepUs(uint32_t us)
+{
+  long crit;
+  if (us >= TICK_US)
+  { // long sleep, the tick list is good enough
+    OS_Sleep((us + TICK_US - 1) / TICK_US);
+    return;
+  }
+  crit = OS_StartCritical();
+  if ((us == 0) || (USleepPt != NULL))
+  { // nothing to wait for, or one-shot busy: fall back to the tick list
+    OS_EndCritical(crit);
+    OS_Sleep(us ? 1 : 0);
+    return;
+  }
+  USleepPt = RunPt;
+  RunPt->sleep = SLEEP_ONESHOT; // not counted down by runperiodicevents
+  BSP_OneShotTask_Start(us);
+  OS_EndCritical(crit);
+  OS_Suspend();
+}
+// one-shot timer expired, make the sleeping thread ready again
+static void wakeusleeper(void)
+{
+  if (USleepPt != NULL)
+  {
+    USleepPt->sleep = 0;
+    USleepPt = NULL;
+    OS_Suspend(); // reschedule now rather than at the end of the slice
+  }
+}
+// statistics of a semaphore, NULL if it has none; called with interrupts disabled
+static OS_SemStats_t *findstats(int32_t *semaPt)
+{
+  int i;
+  for (i = 0; i < NUMSEMSTATS; i++)
+  {
+    if (SemStats[i].sema == semaPt)
+    {
+      return &SemStats[i];
+    }
+  }
+  return NULL;
+}
+// add the time a thread spent blocked; called with interrupts disabled
+static void chargeblocked(OS_SemStats_t *st, tcbType *pt)
+{
+  uint32_t blocked = DWTCYCCNT - pt->blockedAt;
+  if (st != NULL)
+  {
+    st->totalBlocked += blocked;
+    if (blocked > st->maxBlocked)
+    {
+      st->maxBlocked = blocked;
+    }
+  }
 }
 // ******** OS_InitSemaphore ************
 // Initialize counting semaphore
@@ -184,41 +1215,240 @@ void OS_Sleep(uint32_t sleepTime)
 // Outputs: none
 void OS_InitSemaphore(int32_t *semaPt, int32_t value)
 {
-  DisableInterrupts();
+  static const OS_SemStats_t zero;
+  OS_SemStats_t *st;
+  long crit = OS_StartCritical();
   (*semaPt) = value;
-  EnableInterrupts();
+  st = findstats(semaPt);
+  if (st == NULL)
+  {
+    st = findstats(NULL); // free entry, if any
+  }
+  if (st != NULL)
+  {
+    *st = zero; // start counting again
+    st->sema = semaPt;
+  }
+  OS_EndCritical(crit);
+}
+
+// ******** OS_NameSemaphore ************
+// Give a semaphore a name for OS_StatsDump
+// Inputs:  pointer to a semaphore already passed to OS_InitSemaphore
+//          name, a string that stays allocated
+// Outputs: 1 if successful, 0 if the semaphore has no statistics
+int OS_NameSemaphore(int32_t *semaPt, const char *name)
+{
+  long crit = OS_StartCritical();
+  OS_SemStats_t *st = findstats(semaPt);
+  if (st != NULL)
+  {
+    st->name = name;
+  }
+  OS_EndCritical(crit);
+  return st != NULL;
+}
+
+// fill in the figures the MailBox and FIFO count themselves
+static void copystats(OS_SemStats_t *dst, const OS_SemStats_t *src)
+{
+  *dst = *src;
+  if (src->sema == &MailSend)
+  {
+    dst->lost = LostMail;
+  }
+  else if (src->sema == &CurrentSize)
+  {
+    dst->lost = LostFIFO;
+  }
+}
+
+// ******** OS_GetSemStats ************
+// Copy the statistics of one semaphore
+// Statistics are kept for the first NUMSEMSTATS semaphores passed
+// to OS_InitSemaphore, including those inside the MailBox and FIFO
+// Inputs:  pointer to a semaphore
+//          pointer to where the statistics go
+// Outputs: 1 if successful, 0 if the semaphore has no statistics
+int OS_GetSemStats(int32_t *semaPt, OS_SemStats_t *stats)
+{
+  long crit = OS_StartCritical();
+  OS_SemStats_t *st = findstats(semaPt);
+  if ((st != NULL) && (semaPt != NULL))
+  {
+    copystats(stats, st);
+    OS_EndCritical(crit);
+    return 1;
+  }
+  OS_EndCritical(crit);
+  return 0;
+}
+
+// ******** OS_StatsDump ************
+// Copy the statistics of every semaphore in one call
+// Inputs:  buffer for up to max entries
+//          max, size of the buffer
+// Outputs: number of entries copied
+int OS_StatsDump(OS_SemStats_t *buf, int max)
+{
+  int i, n = 0;
+  long crit;
+  for (i = 0; (i < NUMSEMSTATS) && (n < max); i++)
+  {
+    crit = OS_StartCritical(); // one entry at a time, keeps interrupt latency short
+    if (SemStats[i].sema != NULL)
+    {
+      copystats(&buf[n], &SemStats[i]);
+      n++;
+    }
+    OS_EndCritical(crit);
+  }
+  return n;
 }
 
 // ******** OS_Wait ************
-// Decrement semaphore
-// Lab2 spinlock (does not suspend while spinning)
-// Lab3 block if less than zero
+// Decrement semaphore and block if less than zero
 // Inputs:  pointer to a counting semaphore
 // Outputs: none
 void OS_Wait(int32_t *semaPt)
 {
-  long crit = StartCritical();
-  while ((*semaPt) <= 0)
+  long crit = OS_StartCritical();
+  OS_SemStats_t *st = findstats(semaPt);
+  if (st != NULL)
+  {
+    st->waits++;
+  }
+  (*semaPt) = (*semaPt) - 1;
+  if ((*semaPt) < 0)
+  {
+    if (st != NULL)
+    {
+      st->blocks++;
+    }
+    RunPt->blocked = semaPt; // reason it is blocked
+    RunPt->blockedAt = DWTCYCCNT;
+    OS_EndCritical(crit);
+    OS_Suspend(); // run thread switcher
+    return;
+  }
+  OS_EndCritical(crit);
+}
+
+// ******** OS_WaitTimeout ************
+// Decrement semaphore, blocking for at most timeout ticks
+// The countdown is the same one OS_Sleep uses, if it reaches
+// zero before an OS_Signal the count is given back
+// Inputs:  pointer to a counting semaphore
+//          timeout in ticks (msec), 0 behaves like OS_TryWait
+// Outputs: 1 if decremented, 0 if the time ran out first
+int OS_WaitTimeout(int32_t *semaPt, uint32_t timeout)
+{
+  if (timeout == 0)
   {
-    EndCritical(crit);
-    crit = StartCritical();
+    return OS_TryWait(semaPt);
+  }
+  long crit = OS_StartCritical();
+  OS_SemStats_t *st = findstats(semaPt);
+  if (st != NULL)
+  {
+    st->waits++;
   }
   (*semaPt) = (*semaPt) - 1;
-  EndCritical(crit);
+  if ((*semaPt) < 0)
+  {
+    if (st != NULL)
+    {
+      st->blocks++;
+    }
+    RunPt->blocked = semaPt;
+    RunPt->blockedAt = DWTCYCCNT;
+    RunPt->sleep = timeout;
+    RunPt->timedOut = 0;
+    OS_EndCritical(crit);
+    OS_Suspend(); // back here when signalled or timed out
+    return !RunPt->timedOut;
+  }
+  OS_EndCritical(crit);
+  return 1;
+}
+
+// ******** OS_TryWait ************
+// Decrement semaphore if that can be done without blocking
+// Inputs:  pointer to a counting semaphore
+// Outputs: 1 if decremented, 0 if it would have blocked
+int OS_TryWait(int32_t *semaPt)
+{
+  OS_SemStats_t *st;
+  long crit = OS_StartCritical();
+  if ((*semaPt) > 0)
+  {
+    (*semaPt) = (*semaPt) - 1;
+    st = findstats(semaPt);
+    if (st != NULL)
+    {
+      st->waits++;
+    }
+    OS_EndCritical(crit);
+    return 1;
+  }
+  OS_EndCritical(crit);
+  return 0;
 }
 
 // ******** OS_Signal ************
-// Increment semaphore
-// Lab2 spinlock
-// Lab3 wakeup blocked thread if appropriate
+// Increment semaphore, wakeup the highest priority blocked thread
+// If the woken thread has a higher priority than the running thread
+// (or the interrupted thread, when called from an event thread or ISR)
+// the switch happens right away instead of at the end of the slice
 // Inputs:  pointer to a counting semaphore
 // Outputs: none
 void OS_Signal(int32_t *semaPt)
 {
-  //***YOU IMPLEMENT THIS FUNCTION*****
-  long crit = StartCritical();
-  *semaPt = *semaPt + 1;
-  EndCritical(crit);
+  tcbType *pt, *woken = NULL;
+  uint8_t n;
+  long crit = OS_StartCritical();
+  OS_SemStats_t *st = findstats(semaPt);
+  if (st != NULL)
+  {
+    st->signals++;
+  }
+  (*semaPt) = (*semaPt) + 1;
+  if ((*semaPt) <= 0)
+  { // search for the highest priority thread blocked on this semaphore
+    pt = RunPt;
+    for (n = 0; n < NumThreads; n++)
+    {
+      pt = pt->next;
+      if ((pt->blocked == semaPt) && ((woken == NULL) || (pt->priority < woken->priority)))
+      {
+        woken = pt;
+      }
+    }
+    if (woken != NULL)
+    {
+      woken->blocked = NULL; // wakeup this one
+      woken->sleep = 0;      // cancel an OS_WaitTimeout countdown
+      woken->wokenAt = DWTCYCCNT | 1;
+      chargeblocked(st, woken);
+      if ((woken->priority < RunPt->priority) && !overbudget(woken))
+      {
+        OS_EndCritical(crit);
+        OS_Suspend(); // preempt now rather than at the end of the slice
+        return;
+      }
+    }
+  }
+  OS_EndCritical(crit);
+}
+
+// ******** OS_MaxSignalLatency ************
+// Worst time seen from OS_Signal waking a thread to the
+// scheduler switching to it
+// Inputs:  none
+// Outputs: time in clock cycles
+uint32_t OS_MaxSignalLatency(void)
+{
+  return MaxSignalLatency;
 }
 
 // ******** OS_MailBox_Init ************
@@ -232,6 +1462,7 @@ void OS_MailBox_Init(void)
   MailData = 0;
   LostMail = 0;
   OS_InitSemaphore(&MailSend, 0);
+  OS_NameSemaphore(&MailSend, "MailBox");
 }
 
 // ******** OS_MailBox_Send ************
@@ -242,20 +1473,21 @@ void OS_MailBox_Init(void)
 // Errors: data lost if MailBox already has data
 void OS_MailBox_Send(uint32_t data)
 {
-  long crit = StartCritical();
+  long crit = OS_StartCritical();
   MailData = data;
-  if (MailSend)
+  if (MailSend > 0)
   {
     LostMail++;
+    OS_EndCritical(crit);
+    return; // previous mail overwritten, consumer already signalled
   }
-  EndCritical(crit);
+  OS_EndCritical(crit);
   OS_Signal(&MailSend);
 }
 // ******** OS_MailBox_Recv ************
 // retreive mail from the MailBox
 // Use semaphore to synchronize with OS_MailBox_Send
-// Lab 2 spin on semaphore if mailbox empty
-// Lab 3 block on semaphore if mailbox empty
+// block on semaphore if mailbox empty
 // Inputs:  none
 // Outputs: data retreived
 // Errors:  none
@@ -263,101 +1495,109 @@ uint32_t OS_MailBox_Recv(void)
 {
   uint32_t data;
   OS_Wait(&MailSend);
-  long crit = StartCritical();
+  long crit = OS_StartCritical();
   data = MailData;
-  EndCritical(crit);
+  OS_EndCritical(crit);
   return data;
 }
 
-/**
- * @brief Updates the traffic lights based on the pair number and state.
- *
- * This function updates the traffic lights based on the pair number and state provided.
- * It uses a switch statement to determine the pair number and another switch statement
- * to determine the state. Depending on the pair number and state, it calls the appropriate
- * function to draw the strings on the LCD display with the specified color.
- *
- * @param pairnumber The pair number of the traffic lights.
- * @param state The state of the traffic lights.
- */
-void UpdateTrafficLights(int pairnumber, TrafficLightState state)
+// ******** OS_MailBox_RecvTimeout ************
+// retreive mail from the MailBox, blocking for at most timeout ticks
+// Inputs:  pointer to where the data goes
+//          timeout in ticks (msec), 0 does not block
+// Outputs: 1 if mail was retreived, 0 if the time ran out first
+int OS_MailBox_RecvTimeout(uint32_t *dataPt, uint32_t timeout)
 {
-  DisableInterrupts();
-  switch (pairnumber)
+  if (!OS_WaitTimeout(&MailSend, timeout))
   {
-  case 0:
-    switch (state)
-    {
-    case GREEN:
-      BSP_LCD_DrawString(7, 0, "North", LCD_RED);
-      BSP_LCD_DrawString(7, 12, "South", LCD_RED);
-      TrafficLights[pairnumber].state = RED;
-      break;
-    case RED:
-      BSP_LCD_DrawString(7, 0, "North", LCD_GREEN);
-      BSP_LCD_DrawString(7, 12, "South", LCD_GREEN);
-      TrafficLights[pairnumber].state = GREEN;
-    default:
-      break;
-    }
-    break;
-  case 1:
-    switch (state)
-    {
-    case GREEN:
-      BSP_LCD_DrawString(17, 6, "East", LCD_RED);
-      BSP_LCD_DrawString(0, 6, "West", LCD_RED);
-      TrafficLights[pairnumber].state = RED;
-      break;
-    case RED:
-      BSP_LCD_DrawString(17, 6, "East", LCD_GREEN);
-      BSP_LCD_DrawString(0, 6, "West", LCD_GREEN);
-      TrafficLights[pairnumber].state = GREEN;
-    default:
-      break;
-    }
-    break;
-  default:
-    break;
+    return 0; // *dataPt left alone, caller keeps its last value
   }
-  EnableInterrupts();
+  long crit = OS_StartCritical();
+  *dataPt = MailData;
+  OS_EndCritical(crit);
+  return 1;
 }
 
-void SwitchTrafficLightTask(void)
+// ******** OS_MailBox_TryRecv ************
+// retreive mail from the MailBox if there is any, does not block
+// Inputs:  pointer to where the data goes
+// Outputs: 1 if mail was retreived, 0 if the MailBox was empty
+int OS_MailBox_TryRecv(uint32_t *dataPt)
 {
-  for (size_t i = 0; i < NUMLIGHTS; i++)
+  long crit = OS_StartCritical();
+  if (OS_TryWait(&MailSend))
   {
-    UpdateTrafficLights(i, TrafficLights[i].state);
+    *dataPt = MailData;
+    OS_EndCritical(crit);
+    return 1;
   }
+  OS_EndCritical(crit);
+  return 0;
 }
-/**
- * @brief Adds traffic lights to the LCD display.
- *
- * This function draws the labels for the traffic lights on the LCD display.
- * The labels include "North", "East", "South", and "West".
- *
- * @note This function assumes that the LCD display has already been initialized.
- */
 
-void AddTrafficLights(void)
+// ******** OS_FIFO_Init ************
+// Initialize FIFO, one event thread or ISR producer,
+// one main thread consumer
+// Inputs:  none
+// Outputs: none
+void OS_FIFO_Init(void)
+{
+  PutI = GetI = 0;
+  LostFIFO = 0;
+  OS_InitSemaphore(&CurrentSize, 0);
+  OS_NameSemaphore(&CurrentSize, "FIFO");
+}
+
+// ******** OS_FIFO_Put ************
+// Put an entry in the FIFO, does not block
+// Consumer is woken (and preempts if higher priority)
+// Inputs:  data to be stored
+// Outputs: 1 if successful, 0 if the FIFO was full (data lost)
+int OS_FIFO_Put(uint32_t data)
 {
-  for (int i = 0; i < NUMLIGHTS; i++)
+  long crit = OS_StartCritical();
+  if (CurrentSize >= FIFOSIZE)
   {
-    switch (i)
-    {
-    case 0:
-      TrafficLights[i].state = GREEN;
-      UpdateTrafficLights(i, TrafficLights[i].state);
-      TrafficLights[i].pair = i;
-      break;
-    case 1:
-      TrafficLights[i].state = RED;
-      UpdateTrafficLights(i, TrafficLights[i].state);
-      TrafficLights[i].pair = i;
-    default:
-      break;
-    }
+    LostFIFO++;
+    OS_EndCritical(crit);
+    return 0;
   }
+  Fifo[PutI] = data;
+  PutI = (PutI + 1) % FIFOSIZE;
+  OS_EndCritical(crit);
+  OS_Signal(&CurrentSize);
+  return 1;
 }
 
+// ******** OS_FIFO_Get ************
+// Get an entry from the FIFO, block if empty
+// Inputs:  none
+// Outputs: data retrieved
+uint32_t OS_FIFO_Get(void)
+{
+  uint32_t data;
+  OS_Wait(&CurrentSize);
+  long crit = OS_StartCritical();
+  data = Fifo[GetI];
+  GetI = (GetI + 1) % FIFOSIZE;
+  OS_EndCritical(crit);
+  return data;
+}
 
+// ******** OS_FIFO_GetTimeout ************
+// Get an entry from the FIFO, blocking for at most timeout ticks
+// Inputs:  pointer to where the data goes
+//          timeout in ticks (msec), 0 does not block
+// Outputs: 1 if data was retrieved, 0 if the time ran out first
+int OS_FIFO_GetTimeout(uint32_t *dataPt, uint32_t timeout)
+{
+  if (!OS_WaitTimeout(&CurrentSize, timeout))
+  {
+    return 0;
+  }
+  long crit = OS_StartCritical();
+  *dataPt = Fifo[GetI];
+  GetI = (GetI + 1) % FIFOSIZE;
+  OS_EndCritical(crit);
+  return 1;
+}
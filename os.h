@@ -28,14 +28,28 @@
 #include <stdio.h>
 #include "./inc/CortexM.h"
 #include "./inc/BSP.h"
-#define NUMTHREADS 2  // maximum number of threads
+#include "bitband.h"
+#define NUMTHREADS 6  // maximum number of threads, not counting the idle thread
 #define STACKSIZE 100 // number of 32-bit words in stack per thread
 #define PERIODIC_TASKS_NUM 1
 #define NULL_PTR ((void *)0) // Null pointer
-#define NUMPERIODIC 1
+#define NUMPERIODIC 4       // at most 32 with OS_CYCLIC, one frame table bit each
+#define OS_CYCLIC 0         // 1 builds the cyclic executive instead of the preemptive scheduler
+#define CYCLIC_MAXFRAMES 64 // frames in one hyperperiod of the cyclic executive
 #define TIMER_FREQ 1000
 #define TIMER_PRIORITY 6
-#define NUMLIGHTS 2
+#define KERNEL_BASEPRI 2 // kernel critical sections mask NVIC priorities KERNEL_BASEPRI to 7
+                         // priorities 0 to KERNEL_BASEPRI-1 are never delayed by the kernel,
+                         // and their ISRs must not call any OS function
+#define TICK_US (1000000 / TIMER_FREQ) // microseconds per OS tick
+#define LOAD_WINDOW 100                // ticks per OS_CpuLoad sample
+#define ONESHOT_PRIORITY 5             // one-shot sleep wakeup, above the tick
+#define SPORADIC_PRIORITY 6            // sporadic server, same as the tick so neither preempts the other
+#define SPORADIC_QUEUESIZE 8           // aperiodic jobs waiting for the server
+#define SPORADIC_REPLSIZE 8            // pending replenishments
+#define DEFAULT_PRIORITY 8 // main thread priority until OS_SetPriority, 0 is highest
+#define FIFOSIZE 16        // OS_FIFO capacity, 32-bit words
+#define NUMSEMSTATS 8      // semaphores with statistics, the first ones initialized
 
 #define BGCOLOR LCD_BLACK
 #define AXISCOLOR LCD_ORANGE
@@ -69,25 +83,65 @@ struct tcb
   struct tcb *next; // linked-list pointer
   int32_t sleep;    // nonzero if this thread is sleeping
   int32_t *blocked; // nonzero if blocked on this semaphore
+  void (*task)(void);    // thread function, names the thread in the OS_Set calls
+  uint32_t quantum;      // time slice in bus cycles, 0 for the OS_Launch value
+  uint32_t budget;       // bus cycles allowed per replenish period, 0 for no limit
+  uint32_t budgetPeriod; // replenish period in ticks
+  uint32_t budgetNext;   // OS time of the next replenishment
+  uint32_t used;         // bus cycles used since the last replenishment
+  uint32_t priority;     // 0 is highest, equal priorities share round robin
+  uint32_t wokenAt;      // cycle count when OS_Signal made it ready, 0 if not pending
+  uint32_t blockedAt;    // cycle count when it blocked on a semaphore
+  uint32_t timedOut;     // nonzero if its last OS_WaitTimeout gave up
 };
+// statistics kept for each semaphore (and so each mutex, mailbox and FIFO)
+typedef struct
+{
+  int32_t *sema;         // the semaphore, NULL if this entry is unused
+  const char *name;      // from OS_NameSemaphore, NULL if not named
+  uint32_t waits;        // OS_Wait calls, and OS_TryWait calls that succeeded
+  uint32_t blocks;       // OS_Wait calls that had to block
+  uint32_t signals;      // OS_Signal calls
+  uint32_t timeouts;     // waits that gave up before being signalled
+  uint32_t lost;         // data dropped by a full mailbox or FIFO
+  uint32_t maxBlocked;   // longest a thread stayed blocked, clock cycles
+  uint32_t totalBlocked; // time threads spent blocked, clock cycles
+} OS_SemStats_t;
+// what a periodic event thread does when it falls a period or more behind
+typedef enum
+{
+  OVERRUN_SKIP,    // drop the missed releases, keep the original phase
+  OVERRUN_CATCHUP, // run every missed release back to back, one per tick
+  OVERRUN_RESYNC,  // run once now, next release one period from now
+} OverrunPolicy;
+
 typedef struct eventTask
 {
   void (*PeriodicEventTask)(void);
   uint32_t TaskPeriod;
-  uint32_t TaskCounter;
+  uint32_t NextRelease;  // OS time (ticks) of the next release
+  OverrunPolicy Policy;
+  uint32_t Overruns;     // releases that did not start within their period
+  uint32_t MaxLateness;  // worst release lateness seen, in ticks
+  uint32_t Phase;        // OS_SetPhase offset, in ticks
+  uint8_t Realign;       // move to Phase after the next release
+  uint8_t Rearmed;       // OS_ReleaseIn was called during this release
 } eventTask_t, *eventTaskPt;
-typedef enum
-{
-  RED,
-  GREEN,
-} TrafficLightState;
 
-typedef struct
-{
-  int pair;
-  TrafficLightState state;
-  int timer, cars;
-} TrafficLightPair;
+// ******** OS_StartCritical ************
+// Kernel critical section, raises BASEPRI so that every interrupt
+// that may call the OS is masked, while interrupts with priority
+// below KERNEL_BASEPRI keep running; nests, and never lowers a
+// mask that is already higher.  Defined in osasm.s
+// Inputs:  none
+// Outputs: BASEPRI before OS_StartCritical called
+long OS_StartCritical(void);
+
+// ******** OS_EndCritical ************
+// End a kernel critical section, restoring BASEPRI
+// Inputs:  value returned by the matching OS_StartCritical
+// Outputs: none
+void OS_EndCritical(long sr);
 
 // ******** OS_Init ************
 // Initialize operating system, disable interrupts
@@ -97,13 +151,48 @@ typedef struct
 // Outputs: none
 void OS_Init(void);
 
+//******** OS_AddThread ***************
+// Add one main thread to the scheduler
+// Inputs: function pointer to a void/void main thread
+// Outputs: 1 if successful, 0 if this thread can not be added
+// This function will only be called after OS_Init and before OS_Launch
+int OS_AddThread(void (*thread)(void));
+
 //******** OS_AddThreads ***************
-// Add four main threads to the scheduler
+// Add two main threads to the scheduler
 // Inputs: function pointers to four void/void main threads
 // Outputs: 1 if successful, 0 if this thread can not be added
 // This function will only be called once, after OS_Init and before OS_Launch
 int OS_AddThreads(void (*thread0)(void), void (*thread1)(void));
 
+//******** OS_SetPriority ***************
+// Set the priority of a main thread (default DEFAULT_PRIORITY)
+// The scheduler always runs the highest priority ready thread;
+// threads of equal priority share the CPU round robin
+// Inputs: the main thread, as passed to OS_AddThread
+//         priority 0 (highest) to 254
+// Outputs: 1 if successful, 0 if thread is not a main thread
+int OS_SetPriority(void (*thread)(void), uint32_t priority);
+
+//******** OS_SetQuantum ***************
+// Give a main thread its own time slice
+// Inputs: the main thread, as passed to OS_AddThread
+//         number of clock cycles for its time slice, 0 for the OS_Launch value
+// Outputs: 1 if successful, 0 if thread is not a main thread
+// Errors: theTimeSlice must be less than 16,777,216
+int OS_SetQuantum(void (*thread)(void), uint32_t theTimeSlice);
+
+//******** OS_SetBudget ***************
+// Reserve a share of the CPU for a main thread
+// The thread may run for at most budget clock cycles in every
+// period ticks; once it is used up the thread only runs when
+// no other main thread is ready, until its budget is replenished
+// Inputs: the main thread, as passed to OS_AddThread
+//         budget in clock cycles, 0 removes the limit
+//         replenish period in ticks (msec)
+// Outputs: 1 if successful, 0 if thread is not a main thread
+int OS_SetBudget(void (*thread)(void), uint32_t budget, uint32_t period);
+
 //******** OS_AddPeriodicEventThreads ***************
 // Add two background periodic event threads
 // Typically this function receives the highest priority
@@ -116,13 +205,161 @@ int OS_AddThreads(void (*thread0)(void), void (*thread1)(void));
 // These threads can call OS_Signal
 int OS_AddPeriodicEventThread(void (*thread)(void), uint32_t period);
 
+//******** OS_AddHighRateEventThread ***************
+// Add a periodic event thread with its own hardware timer, for
+// threads that run faster than the tick or cannot stand a tick of
+// release jitter; the first one gets Wide Timer 4A, the second
+// Wide Timer 3A, each with its own interrupt priority
+// Inputs: pointer to a void/void event thread function
+//         freq is releases per second, 1 Hz to 10 kHz
+//         priority is the NVIC priority KERNEL_BASEPRI to 7; the
+//         timer driver runs 7 at 6, above the SysTick scheduler
+// Outputs: 1 if successful, 0 if
+//          freq is 0 or above 10 kHz,
+//          priority is below KERNEL_BASEPRI (the thread may call the OS,
+//          so the kernel must be able to mask it) or above 7, or
+//          both timers are in use
+// The same rules as OS_AddPeriodicEventThread apply to the thread
+int OS_AddHighRateEventThread(void (*thread)(void), uint32_t freq, uint8_t priority);
+
+//******** OS_GetReleaseJitter ***************
+// Worst release jitter of a high rate event thread, the largest
+// difference between the time between two releases and its period
+// Inputs: the event thread, as passed to OS_AddHighRateEventThread
+// Outputs: jitter in clock cycles, 0 if thread is not a high rate thread
+uint32_t OS_GetReleaseJitter(void (*thread)(void));
+
+//******** OS_SetOverrunPolicy ***************
+// Choose how a periodic event thread recovers when a load spike
+// delays it by a period or more (default OVERRUN_SKIP)
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+//         policy OVERRUN_SKIP, OVERRUN_CATCHUP or OVERRUN_RESYNC
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+int OS_SetOverrunPolicy(void (*thread)(void), OverrunPolicy policy);
+
+//******** OS_GetOverruns ***************
+// Number of releases of a periodic event thread that did not
+// start within their own period
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+// Outputs: overrun count, 0 if thread is not a periodic event thread
+uint32_t OS_GetOverruns(void (*thread)(void));
+
+//******** OS_GetMaxLateness ***************
+// Worst lateness of any release of a periodic event thread
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+// Outputs: lateness in ticks (msec), 0 if thread is not a periodic event thread
+uint32_t OS_GetMaxLateness(void (*thread)(void));
+
+//******** OS_SetPeriod ***************
+// Change the period of a periodic event thread while running
+// The release already pending is kept; the new period applies
+// from it onwards, so no release is doubled or skipped
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+//         new period in ticks (msec)
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+// Not supported with OS_CYCLIC (returns 0)
+int OS_SetPeriod(void (*thread)(void), uint32_t period);
+
+//******** OS_SetPhase ***************
+// Align the releases of a periodic event thread to OS time
+// After the pending release, releases move to the times t with
+// (t - phase) a multiple of the period; the release after the
+// pending one is the first such time, so none is doubled or skipped.
+// t counts ticks since OS_Init without wrapping, so threads keep
+// their relative phases when OS time passes 2^32 ms (49.7 days)
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+//         phase in ticks (msec), taken modulo the period
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+// Not supported with OS_CYCLIC (returns 0)
+int OS_SetPhase(void (*thread)(void), uint32_t phase);
+
+//******** OS_PauseTask ***************
+// Stop releasing a periodic event thread
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+// Not supported with OS_CYCLIC (returns 0)
+int OS_PauseTask(void (*thread)(void));
+
+//******** OS_ResumeTask ***************
+// Release a paused periodic event thread again, on its old
+// schedule; releases that fell due while paused are dropped
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+// Not supported with OS_CYCLIC (returns 0)
+int OS_ResumeTask(void (*thread)(void));
+
+//******** OS_ReleaseIn ***************
+// Set the next release of a periodic event thread to a number of
+// ticks from now, in place of the one its period would give; a
+// thread that calls this on itself every run is a one-shot timer
+// that runs only when it has work, at times it chooses
+// Inputs: the event thread, as passed to OS_AddPeriodicEventThread
+//         delay in ticks (msec), 0 for the next tick
+// Outputs: 1 if successful, 0 if thread is not a periodic event thread
+// Not supported with OS_CYCLIC (returns 0); there a thread that times
+// itself this way must run from a fixed slot and check what is due
+int OS_ReleaseIn(void (*thread)(void), uint32_t delay);
+
+//******** OS_Time ***************
+// Number of ticks since OS_Init, counting ticks that were
+// missed because the tick interrupt was held off
+// Inputs: none
+// Outputs: time in ticks (msec)
+uint32_t OS_Time(void);
+
+//******** OS_CpuLoad ***************
+// Share of the processor used by everything except the idle
+// thread, averaged over about the last 8 load windows
+// Inputs: none
+// Outputs: load in 0.1% units, 0 to 1000
+// Not supported with OS_CYCLIC (returns 0)
+uint32_t OS_CpuLoad(void);
+
 //******** OS_Launch ***************
 // Start the scheduler, enable interrupts
 // Inputs: number of clock cycles for each time slice
 // Outputs: none (does not return)
 // Errors: theTimeSlice must be less than 16,777,216
+// With OS_CYCLIC the periodic event threads are laid out in a
+// frame table covering one hyperperiod (frame = gcd of the periods,
+// hyperperiod = lcm) and dispatched straight from the table; the
+// first main thread runs as the background loop, other main threads
+// never run, and theTimeSlice is ignored
+// Errors: with OS_CYCLIC, hangs if the hyperperiod needs more
+//         than CYCLIC_MAXFRAMES frames
 void OS_Launch(uint32_t theTimeSlice);
+
+// ******** OS_Suspend ************
+// Abandon current thread, go to next one
+// Inputs:  none
+// Outputs: none
+// With OS_CYCLIC, waits until the background loop is ready again;
+// called from an interrupt it does nothing
+void OS_Suspend(void);
+
+// ******** OS_Sleep ************
+// place this thread into a dormant state
+// input:  number of msec to sleep
+// output: none
+// OS_Sleep(0) implements cooperative multitasking
 void OS_Sleep(uint32_t sleepTime);
+
+// ******** OS_SleepUs ************
+// place this thread into a dormant state for a short time
+// Sleeps shorter than one tick use the one-shot timer and wake
+// exactly this thread after us microseconds, no rounding. One
+// thread at a time may own the one-shot; a short sleep asked for
+// while it is busy sleeps until the next tick instead.
+// Sleeps of one tick or longer are rounded up to whole ticks and
+// go through the tick list like OS_Sleep.
+// OS_SleepUs(0) behaves like OS_Sleep(0) and only gives up the slice.
+// If every main thread is asleep the idle thread runs until the
+// one-shot or the tick wakes one.
+// Lab2 has no caller; this is API for drivers that must wait less
+// than a tick, such as a sensor conversion or an LCD reset pulse.
+// input:  number of usec to sleep
+// output: none
+void OS_SleepUs(uint32_t us);
 // ******** OS_InitSemaphore ************
 // Initialize counting semaphore
 // Inputs:  pointer to a semaphore
@@ -130,22 +367,66 @@ void OS_Sleep(uint32_t sleepTime);
 // Outputs: none
 void OS_InitSemaphore(int32_t *semaPt, int32_t value);
 
+// ******** OS_NameSemaphore ************
+// Give a semaphore a name for OS_StatsDump
+// Inputs:  pointer to a semaphore already passed to OS_InitSemaphore
+//          name, a string that stays allocated
+// Outputs: 1 if successful, 0 if the semaphore has no statistics
+int OS_NameSemaphore(int32_t *semaPt, const char *name);
+
+// ******** OS_GetSemStats ************
+// Copy the statistics of one semaphore
+// Statistics are kept for the first NUMSEMSTATS semaphores passed
+// to OS_InitSemaphore, including those inside the MailBox and FIFO
+// Inputs:  pointer to a semaphore
+//          pointer to where the statistics go
+// Outputs: 1 if successful, 0 if the semaphore has no statistics
+int OS_GetSemStats(int32_t *semaPt, OS_SemStats_t *stats);
+
+// ******** OS_StatsDump ************
+// Copy the statistics of every semaphore in one call
+// Inputs:  buffer for up to max entries
+//          max, size of the buffer
+// Outputs: number of entries copied
+int OS_StatsDump(OS_SemStats_t *buf, int max);
+
 // ******** OS_Wait ************
-// Decrement semaphore
-// Lab2 spinlock (does not suspend while spinning)
-// Lab3 block if less than zero
+// Decrement semaphore and block if less than zero
 // Inputs:  pointer to a counting semaphore
 // Outputs: none
 void OS_Wait(int32_t *semaPt);
 
+// ******** OS_WaitTimeout ************
+// Decrement semaphore, blocking for at most timeout ticks
+// The timeout shares the tick countdown used by OS_Sleep, so
+// waits without a timeout cost nothing extra
+// Inputs:  pointer to a counting semaphore
+//          timeout in ticks (msec), 0 behaves like OS_TryWait
+// Outputs: 1 if decremented, 0 if the time ran out first
+int OS_WaitTimeout(int32_t *semaPt, uint32_t timeout);
+
+// ******** OS_TryWait ************
+// Decrement semaphore if that can be done without blocking
+// Inputs:  pointer to a counting semaphore
+// Outputs: 1 if decremented, 0 if it would have blocked
+int OS_TryWait(int32_t *semaPt);
+
 // ******** OS_Signal ************
-// Increment semaphore
-// Lab2 spinlock
-// Lab3 wakeup blocked thread if appropriate
+// Increment semaphore, wakeup the highest priority blocked thread
+// If the woken thread has a higher priority than the running thread
+// (or the interrupted thread, when called from an event thread or ISR)
+// the switch happens right away instead of at the end of the slice
 // Inputs:  pointer to a counting semaphore
 // Outputs: none
 void OS_Signal(int32_t *semaPt);
 
+// ******** OS_MaxSignalLatency ************
+// Worst time seen from OS_Signal waking a thread to the
+// scheduler switching to it
+// Inputs:  none
+// Outputs: time in clock cycles
+uint32_t OS_MaxSignalLatency(void);
+
 // ******** OS_MailBox_Init ************
 // Initialize communication channel
 // Producer is an event thread, consumer is a main thread
@@ -170,9 +451,78 @@ void OS_MailBox_Send(uint32_t data);
 // Outputs: data retreived
 // Errors:  none
 uint32_t OS_MailBox_Recv(void);
-void static runperiodicevents(void);
-void AddTrafficLights(void);
-void UpdateTrafficLights(int pairnumber, TrafficLightState state);
-void AddTrafficLights(void);
-void SwitchTrafficLightTask(void);
+
+// ******** OS_MailBox_RecvTimeout ************
+// retreive mail from the MailBox, blocking for at most timeout ticks
+// Inputs:  pointer to where the data goes
+//          timeout in ticks (msec), 0 does not block
+// Outputs: 1 if mail was retreived, 0 if the time ran out first
+int OS_MailBox_RecvTimeout(uint32_t *dataPt, uint32_t timeout);
+
+// ******** OS_MailBox_TryRecv ************
+// retreive mail from the MailBox if there is any, does not block
+// Inputs:  pointer to where the data goes
+// Outputs: 1 if mail was retreived, 0 if the MailBox was empty
+int OS_MailBox_TryRecv(uint32_t *dataPt);
+
+// ******** OS_FIFO_Init ************
+// Initialize FIFO, one event thread or ISR producer,
+// one main thread consumer
+// Inputs:  none
+// Outputs: none
+void OS_FIFO_Init(void);
+
+// ******** OS_FIFO_Put ************
+// Put an entry in the FIFO, does not block
+// Consumer is woken (and preempts if higher priority)
+// Inputs:  data to be stored
+// Outputs: 1 if successful, 0 if the FIFO was full (data lost)
+int OS_FIFO_Put(uint32_t data);
+
+// ******** OS_FIFO_Get ************
+// Get an entry from the FIFO, block if empty
+// Inputs:  none
+// Outputs: data retrieved
+uint32_t OS_FIFO_Get(void);
+
+// ******** OS_FIFO_GetTimeout ************
+// Get an entry from the FIFO, blocking for at most timeout ticks
+// Inputs:  pointer to where the data goes
+//          timeout in ticks (msec), 0 does not block
+// Outputs: 1 if data was retrieved, 0 if the time ran out first
+int OS_FIFO_GetTimeout(uint32_t *dataPt, uint32_t timeout);
+
+// ******** OS_Sporadic_Init ************
+// Start the sporadic server that runs aperiodic jobs
+// Jobs run to completion in the PendSV handler, above all main
+// threads and at the priority of the periodic event threads, using
+// at most budget clock cycles in any window of period ticks
+// Each cycle consumed is given back period ticks after the server
+// started the job that consumed it
+// Inputs:  budget in clock cycles
+//          replenish period in ticks (msec)
+// Outputs: 1 if successful, 0 if the parameters are invalid
+// Called after OS_Init and before OS_Launch
+int OS_Sporadic_Init(uint32_t budget, uint32_t period);
+
+// ******** OS_Sporadic_Post ************
+// Queue an aperiodic job for the sporadic server
+// May be called from main threads, event threads or interrupts
+// Inputs:  void/void job that runs to completion; it cannot
+//          spin, block, loop, sleep, or kill
+// Outputs: 1 if queued, 0 if the queue is full (job dropped)
+int OS_Sporadic_Post(void (*job)(void));
+
+// ******** OS_Sporadic_MaxResponse ************
+// Worst response time seen so far, from OS_Sporadic_Post
+// until the job returned
+// Inputs:  none
+// Outputs: time in clock cycles
+uint32_t OS_Sporadic_MaxResponse(void);
+
+// ******** OS_Sporadic_Dropped ************
+// Number of jobs lost because the sporadic queue was full
+// Inputs:  none
+// Outputs: count
+uint32_t OS_Sporadic_Dropped(void);
 #endif
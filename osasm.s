@@ -13,13 +13,18 @@
         PRESERVE8
 
         EXTERN  RunPt            ; currently running thread
+        EXTERN  OSBasePri        ; KERNEL_BASEPRI in the BASEPRI format
         EXPORT  StartOS
         EXPORT  SysTick_Handler
+        EXPORT  OS_StartCritical
+        EXPORT  OS_EndCritical
         IMPORT  Scheduler
 
 
 SysTick_Handler                ; 1) Saves R0-R3,R12,LR,PC,PSR
-    CPSID   I                  ; 2) Prevent interrupt during switch
+    LDR     R2, =OSBasePri     ; 2) Prevent kernel interrupts during switch,
+    LDR     R2, [R2]           ;    zero-latency interrupts still run
+    MSR     BASEPRI, R2
     PUSH    {R4-R11}		  
     LDR     R0, =RunPt         
     LDR     R1, [R0]           
@@ -30,7 +35,8 @@ SysTick_Handler                ; 1) Saves R0-R3,R12,LR,PC,PSR
     LDR     R1, [R0]           
     LDR     SP, [R1]           
     POP     {R4-R11}
-    CPSIE   I                  ; 9) tasks run with interrupts enabled
+    MOVS    R2, #0             ; 9) tasks run with interrupts enabled
+    MSR     BASEPRI, R2
     BX      LR                 ; 10) restore R0-R3,R12,LR,PC,PSR
 
 StartOS
@@ -46,5 +52,24 @@ StartOS
     CPSIE   I                  ; Enable interrupts at processor level
     BX      LR                 ; start first thread
 
+;*********** OS_StartCritical ************************
+; mask interrupts at or below the kernel priority
+; inputs:  none
+; outputs: previous BASEPRI
+OS_StartCritical
+    MRS     R0, BASEPRI        ; save old mask
+    LDR     R1, =OSBasePri
+    LDR     R1, [R1]
+    MSR     BASEPRI_MAX, R1    ; only ever raises the mask
+    BX      LR
+
+;*********** OS_EndCritical ************************
+; restore BASEPRI to its value before OS_StartCritical
+; inputs:  previous BASEPRI
+; outputs: none
+OS_EndCritical
+    MSR     BASEPRI, R0
+    BX      LR
+
     ALIGN
     END
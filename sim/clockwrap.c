@@ -0,0 +1,123 @@
+// clockwrap.c
+// Runs on a Linux host
+// Runs a controller on a calendar of timing plans for longer than
+// its 32-bit clocks can count, 2^32 ms or about 49.7 days, and checks
+// that every cycle starts on the plan for its time of the week and,
+// once a coordinated plan has had SETTLE cycles to reach its offset,
+// that phase 0 turns green exactly at the offset.  The
+// shared clock is set once at boot, as the LCD intersection does, so
+// it passes 2^32 ms a few days before the tick count does; both wraps
+// fall inside the run.  The true time is kept in 64 bits alongside.
+// Build and run from the top of the repository:
+//   gcc -O2 -o clockwrap sim/clockwrap.c sim/stubs.c traffic.c
+//   ./clockwrap [days]
+// Exits with 1 if any cycle started on the wrong plan or off its offset.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../traffic.h"
+
+static const trafficGroup_t Groups[2] = {
+    {{NULL, NULL}, {0, 0}, {0, 0}}, // arterial
+    {{NULL, NULL}, {0, 0}, {0, 0}}, // side street
+};
+static const trafficPhase_t Phases[2] = {
+    {0x01, 50000, 0, 0, 3000, 1000}, // arterial 50 s, yellow 3 s, all-red 1 s
+    {0x02, 32000, 0, 0, 3000, 1000}, // side street 32 s, a 90 s cycle
+};
+static const trafficLayout_t Layout = {Groups, 2, Phases, 2};
+static const trafficPlan_t Plans[3] = {
+    {&Layout, 90000, 20000},        // day
+    {&Layout, 90000, 65000},        // peak
+    {&Layout, 90000, TRAFFIC_FREE}, // night
+};
+static const char *const PlanNames[3] = {"day", "peak", "night"};
+#define DAILY(d)                                                               \
+  {TRAFFIC_AT(d, 6, 0), &Plans[0]}, {TRAFFIC_AT(d, 7, 30), &Plans[1]},         \
+      {TRAFFIC_AT(d, 9, 0), &Plans[0]}, {TRAFFIC_AT(d, 22, 0), &Plans[2]}
+static const trafficEvent_t Events[] = {DAILY(0), DAILY(1), DAILY(2), DAILY(3),
+                                        DAILY(4), DAILY(5), DAILY(6)};
+static const trafficCalendar_t Calendar = {Events, sizeof(Events) / sizeof(Events[0])};
+
+#define SETTLE 8 // cycles a new plan may take to reach its offset
+
+static trafficCtrl_t Ctrl;
+static TrafficLightPair Lights[2];
+
+// plan in force at a time of the week
+static const trafficPlan_t *planat(uint32_t week)
+{
+  const trafficPlan_t *plan = Calendar.events[Calendar.numEvents - 1].plan;
+  int i;
+  for (i = 0; (i < Calendar.numEvents) && (Calendar.events[i].at <= week); i++)
+  {
+    plan = Calendar.events[i].plan;
+  }
+  return plan;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t days, now = 0, next, start = 0, week, late, since = 0;
+  uint64_t t = 0, end, started; // ms since boot
+  uint32_t cycles = 0, wrong = 0, off = 0;
+  const trafficPlan_t *want, *last = NULL;
+  days = (argc > 1) ? (uint32_t)atoi(argv[1]) : 52;
+  if ((days == 0) || (days > 1000))
+  {
+    printf("usage: clockwrap [days 1-1000]\n");
+    return 1;
+  }
+  if (!Traffic_Init(&Ctrl, &Layout, Lights, 0, now))
+  {
+    printf("bad layout\n");
+    return 1;
+  }
+  Traffic_SetClock(&Ctrl, TRAFFIC_BOOTCLOCK, now);
+  if (!Traffic_Schedule(&Ctrl, &Calendar))
+  {
+    printf("bad calendar\n");
+    return 1;
+  }
+  printf("shared clock passes 2^32 ms on day %.2f, tick count on day %.2f\n",
+         (4294967296.0 - TRAFFIC_BOOTCLOCK) / TRAFFIC_DAY, 4294967296.0 / TRAFFIC_DAY);
+  next = Ctrl.next;
+  end = (uint64_t)days * TRAFFIC_DAY;
+  while (t < end)
+  {
+    t += next - now;
+    now = next;
+    next = Traffic_Run(&Ctrl, now);
+    if ((Ctrl.phase != 0) || (Ctrl.interval != TRAFFIC_GREEN) || (Ctrl.start == start) ||
+        (Ctrl.plan == NULL))
+    {
+      continue;
+    }
+    start = Ctrl.start; // a cycle started on the calendar's plan
+    started = t - (uint32_t)(now - start);
+    week = (uint32_t)((TRAFFIC_BOOTCLOCK + started) % TRAFFIC_WEEK);
+    want = planat(week);
+    cycles++;
+    if ((Ctrl.plan != want) && (wrong++ < 10))
+    {
+      printf("day %6.2f: %s running, %s due\n", (double)started / TRAFFIC_DAY,
+             PlanNames[Ctrl.plan - Plans], PlanNames[want - Plans]);
+    }
+    since = (Ctrl.plan == last) ? since + 1 : 0;
+    last = Ctrl.plan;
+    if ((Ctrl.plan->offset == TRAFFIC_FREE) || (since < SETTLE))
+    {
+      continue;
+    }
+    late = (week + TRAFFIC_WEEK - Ctrl.plan->offset) % Ctrl.plan->cycle;
+    if ((late != 0) && (off++ < 10))
+    {
+      printf("day %6.2f: %s phase 0 %u ms off its offset\n", (double)started / TRAFFIC_DAY,
+             PlanNames[Ctrl.plan - Plans], late);
+    }
+  }
+  printf("%u days, %u cycles on the calendar, %u on the wrong plan, %u off the offset\n", days,
+         cycles, wrong, off);
+  return (wrong || off) ? 1 : 0;
+}
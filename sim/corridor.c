@@ -0,0 +1,183 @@
+// corridor.c
+// Runs on a Linux host
+// An arterial of intersections one block apart, each a traffic.c
+// controller that booted at a random time.  The arterial (East-West)
+// gets phase 0 and most of the cycle, the side streets the rest.
+// Three runs on the same random traffic:
+//   free   each controller times its phases from its own boot
+//   wave   coordinated, offsets for an eastbound green wave
+//   shift  as wave, then half way through the offsets change to a
+//          westbound wave and the controllers move to them gradually
+// Build and run from the top of the repository:
+//   gcc -O2 -o corridor sim/corridor.c sim/sim.c sim/stubs.c traffic.c
+//   ./corridor [intersections] [hours] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "sim.h"
+
+#define CORRIDOR_MAX 64
+#define TRAVEL 17000 // ms per block, 250 m at 53 km/h
+#define PERIOD (TRAVEL / SIM_STEP) // steps per exchange period
+
+// approaches by direction of travel, side streets are group 0
+enum { NORTHBOUND, SOUTHBOUND, EASTBOUND, WESTBOUND };
+static const int ApproachGroup[4] = {0, 0, 1, 1};
+static const uint32_t EdgeRate[4] = {200, 200, 900, 500}; // cars per hour entering
+
+static const trafficGroup_t Groups[2] = {
+    {{NULL, NULL}, {0, 0}, {0, 0}}, // side street
+    {{NULL, NULL}, {0, 0}, {0, 0}}, // arterial
+};
+static const trafficPhase_t Phases[2] = {
+    {0x02, 40000, 0, 0, 3000, 1000}, // arterial 40 s, yellow 3 s, all-red 1 s
+    {0x01, 20000, 0, 0, 3000, 1000}, // side street 20 s
+};
+static const trafficLayout_t Layout = {Groups, 2, Phases, 2};
+
+typedef struct
+{
+  simIntersection_t sim;
+  trafficCtrl_t ctrl;
+  TrafficLightPair lights[2];
+  simLink_t out[2]; // eastbound and westbound roads leaving
+} corridorNode_t;
+
+static corridorNode_t Node[CORRIDOR_MAX];
+static int NumNodes;
+
+// build the corridor, every run has the same boot times and traffic
+static int corridorinit(uint32_t seed)
+{
+  uint32_t rates[4], rng = seed, boot;
+  int i, d;
+  for (i = 0; i < NumNodes; i++)
+  {
+    for (d = 0; d < 4; d++)
+    { // the arterial only gets new cars at its ends
+      rates[d] = EdgeRate[d];
+    }
+    if (i > 0)
+    {
+      rates[EASTBOUND] = 0;
+    }
+    if (i < NumNodes - 1)
+    {
+      rates[WESTBOUND] = 0;
+    }
+    rng = rng * 1664525 + 1013904223;
+    boot = (rng >> 8) % Traffic_Cycle(&Layout);
+    if (!Traffic_Init(&Node[i].ctrl, &Layout, Node[i].lights, 0, 0 - boot) ||
+        !Sim_Init(&Node[i].sim, &Node[i].ctrl, NULL, ApproachGroup, rates, 4, seed + i))
+    {
+      return 0;
+    }
+    Traffic_SetClock(&Node[i].ctrl, 0, 0); // the simulation clock is the shared one
+  }
+  for (i = 0; i < NumNodes - 1; i++)
+  {
+    Sim_Connect(&Node[i].sim, EASTBOUND, &Node[i].out[0], TRAVEL, &Node[i + 1].sim, EASTBOUND);
+    Sim_Connect(&Node[i + 1].sim, WESTBOUND, &Node[i + 1].out[1], TRAVEL, &Node[i].sim,
+                WESTBOUND);
+  }
+  return 1;
+}
+
+// offsets for a green wave, each green starts one block's travel after the last
+static void greenwave(int eastbound)
+{
+  uint32_t cycle = Traffic_Cycle(&Layout);
+  int i;
+  for (i = 0; i < NumNodes; i++)
+  {
+    Traffic_Coordinate(&Node[i].ctrl,
+                       (uint32_t)(eastbound ? i : NumNodes - 1 - i) * TRAVEL % cycle);
+  }
+}
+
+static void run(const char *name, int mode, uint32_t hours, uint32_t seed)
+{
+  uint32_t periods = hours * (3600000 / TRAVEL), p, step, settled = 0, shifted = 0;
+  uint64_t departed[4] = {0}, stopped = 0;
+  double delay[4] = {0};
+  simApproach_t *a;
+  int i, d;
+  if (!corridorinit(seed))
+  {
+    printf("%s: bad layout\n", name);
+    return;
+  }
+  if (mode)
+  {
+    greenwave(1);
+  }
+  for (p = 0; p < periods; p++)
+  {
+    if ((mode == 2) && (p == periods / 2))
+    {
+      greenwave(0);
+      shifted = Node[0].sim.now;
+    }
+    for (i = 0; i < NumNodes; i++)
+    {
+      Sim_Receive(&Node[i].sim);
+      for (step = 0; step < PERIOD; step++)
+      {
+        Sim_Step(&Node[i].sim);
+      }
+      if (Node[i].ctrl.error || Node[i].ctrl.adjust)
+      { // still moving towards its offset
+        settled = Node[i].sim.now;
+      }
+    }
+  }
+  for (i = 0; i < NumNodes; i++)
+  {
+    for (d = 0; d < 4; d++)
+    {
+      a = &Node[i].sim.app[d];
+      departed[(d == NORTHBOUND) ? SOUTHBOUND : d] += a->departed;
+      delay[(d == NORTHBOUND) ? SOUTHBOUND : d] += a->totalDelay;
+      if (ApproachGroup[d] == 1)
+      {
+        stopped += a->departed - a->hist[0];
+      }
+    }
+  }
+  printf("%-6s %8.1f %8.1f", name, Sim_Throughput(&Node[NumNodes - 1].sim, EASTBOUND),
+         Sim_Throughput(&Node[0].sim, WESTBOUND));
+  for (d = SOUTHBOUND; d <= WESTBOUND; d++)
+  { // delay per intersection passed, side streets together
+    printf(" %8.1f", departed[d] ? delay[d] / departed[d] / 1000 : 0);
+  }
+  printf(" %8.1f", (departed[EASTBOUND] + departed[WESTBOUND])
+                       ? 100.0 * stopped / (departed[EASTBOUND] + departed[WESTBOUND])
+                       : 0);
+  if (mode)
+  {
+    printf(" %8.0f", (settled - shifted) / 1000.0);
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t hours, seed;
+  NumNodes = (argc > 1) ? atoi(argv[1]) : 10;
+  hours = (argc > 2) ? (uint32_t)atoi(argv[2]) : 4;
+  seed = (argc > 3) ? (uint32_t)atoi(argv[3]) : 1;
+  if ((NumNodes < 2) || (NumNodes > CORRIDOR_MAX) || (hours == 0) || (hours > 1000) || (seed == 0))
+  {
+    printf("usage: corridor [intersections 2-%d] [hours 1-1000] [seed nonzero]\n", CORRIDOR_MAX);
+    return 1;
+  }
+  printf("%d intersections %u m apart, cycle %u s, %u h simulated, seed %u\n", NumNodes,
+         TRAVEL * 53 / 3600, Traffic_Cycle(&Layout) / 1000, hours, seed);
+  printf("%-6s %8s %8s %8s %8s %8s %8s %8s\n", "", "east/h", "west/h", "side s", "east s",
+         "west s", "stops %", "settle s");
+  run("free", 0, hours, seed);
+  run("wave", 1, hours, seed);
+  run("shift", 2, hours, seed);
+  return 0;
+}
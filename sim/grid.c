@@ -0,0 +1,221 @@
+// grid.c
+// Runs on a Linux host
+// A city grid of side by side intersections, each a traffic.c
+// controller with its own TrafficLights state, joined by road links
+// one block long.  Cars enter at the edges, drive straight through
+// and leave at the far edge, so every row and column is a corridor.
+// The grid is stepped one exchange period (one block's travel time)
+// at a time; within a period each group of intersections is a task
+// for the work-stealing pool in pool.c.  The same grid is run with
+// 1, 2, 4 ... up to the given number of threads to show how the
+// simulated vehicle-seconds per wall second scale; the traffic
+// results must not change with the number of threads.
+// Build and run from the top of the repository:
+//   gcc -O2 -pthread -DSIM_MAXAPPROACHES=4 -DSIM_QUEUESIZE=256 -DSIM_HISTBINS=120 -o grid
+//       sim/grid.c sim/sim.c sim/pool.c sim/stubs.c traffic.c
+//   ./grid [side] [hours] [threads] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "sim.h"
+#include "pool.h"
+
+#define GRID_TRAVEL 15000 // ms per block, 200 m at 50 km/h
+#define GRID_RATE 300     // cars per hour entering at each edge
+#define GRID_CHUNK 16     // intersections per task
+#define PERIOD (GRID_TRAVEL / SIM_STEP) // steps per exchange period
+
+// approaches by direction of travel, North-South is group 0
+enum { NORTHBOUND, SOUTHBOUND, EASTBOUND, WESTBOUND };
+static const int ApproachGroup[4] = {0, 0, 1, 1};
+static const int DX[4] = {0, 0, 1, -1};
+static const int DY[4] = {-1, 1, 0, 0};
+
+static const trafficGroup_t Groups[2] = {
+    {{NULL, NULL}, {0, 0}, {0, 0}},
+    {{NULL, NULL}, {0, 0}, {0, 0}},
+};
+static const trafficPhase_t Phases[2] = {
+    {0x01, 30000, 4000, 2500, 3000, 1000}, // 4 to 30 s green, yellow 3 s, all-red 1 s
+    {0x02, 30000, 4000, 2500, 3000, 1000},
+};
+static const trafficLayout_t Layout = {Groups, 2, Phases, 2};
+
+typedef struct
+{
+  simIntersection_t sim;
+  trafficCtrl_t ctrl;
+  TrafficLightPair lights[2];
+  simLink_t out[4]; // roads leaving, by direction of travel
+} gridNode_t;
+
+typedef struct
+{
+  gridNode_t *node;
+  int side, count;
+} grid_t;
+
+// build the grid, every run starts from the same state
+static int gridinit(grid_t *grid, int side, uint32_t seed)
+{
+  gridNode_t *n, *to;
+  uint32_t rates[4], rng;
+  int i, d, x, y;
+  grid->side = side;
+  grid->count = side * side;
+  for (i = 0; i < grid->count; i++)
+  {
+    n = &grid->node[i];
+    x = i % side;
+    y = i / side;
+    for (d = 0; d < 4; d++)
+    { // only the edges have traffic of their own
+      x -= DX[d];
+      y -= DY[d];
+      rates[d] = ((x < 0) || (x >= side) || (y < 0) || (y >= side)) ? GRID_RATE : 0;
+      x += DX[d];
+      y += DY[d];
+    }
+    rng = seed + 0x9E3779B9u * (uint32_t)(i + 1);
+    if (!Traffic_Init(&n->ctrl, &Layout, n->lights, 0, 0) ||
+        !Sim_Init(&n->sim, &n->ctrl, NULL, ApproachGroup, rates, 4, rng ? rng : 1))
+    {
+      return 0;
+    }
+  }
+  for (i = 0; i < grid->count; i++)
+  {
+    n = &grid->node[i];
+    for (d = 0; d < 4; d++)
+    {
+      x = i % side + DX[d];
+      y = i / side + DY[d];
+      if ((x >= 0) && (x < side) && (y >= 0) && (y < side))
+      {
+        to = &grid->node[y * side + x];
+        Sim_Connect(&n->sim, d, &n->out[d], GRID_TRAVEL, &to->sim, d);
+      }
+    }
+  }
+  return 1;
+}
+
+// one task: a chunk of intersections through one exchange period
+static void gridtask(void *arg, uint32_t task)
+{
+  grid_t *grid = arg;
+  int i, last = (task + 1) * GRID_CHUNK;
+  uint32_t step;
+  if (last > grid->count)
+  {
+    last = grid->count;
+  }
+  for (i = task * GRID_CHUNK; i < last; i++)
+  {
+    Sim_Receive(&grid->node[i].sim);
+    for (step = 0; step < PERIOD; step++)
+    {
+      Sim_Step(&grid->node[i].sim);
+    }
+  }
+}
+
+static double wallclock(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// simulate, then add up the whole network; returns the wall time
+static double gridrun(grid_t *grid, int threads, uint32_t hours, uint32_t seed, double base)
+{
+  static pool_t pool;
+  gridNode_t *n;
+  simApproach_t *a;
+  double wall, vehicleSec = 0, delay = 0;
+  uint32_t periods = hours * (3600000 / GRID_TRAVEL), p, tasks;
+  uint64_t left = 0, departed = 0, dropped = 0;
+  int i, d;
+  if (!gridinit(grid, grid->side, seed) || !Pool_Init(&pool, threads))
+  {
+    printf("%7d  could not start\n", threads);
+    return 0;
+  }
+  tasks = (grid->count + GRID_CHUNK - 1) / GRID_CHUNK;
+  wall = wallclock();
+  for (p = 0; p < periods; p++)
+  {
+    Pool_Run(&pool, tasks, &gridtask, grid);
+  }
+  wall = wallclock() - wall;
+  for (i = 0; i < grid->count; i++)
+  {
+    n = &grid->node[i];
+    for (d = 0; d < 4; d++)
+    {
+      a = &n->sim.app[d];
+      vehicleSec += a->queueSum * (SIM_STEP / 1000.0);
+      departed += a->departed;
+      delay += a->totalDelay;
+      dropped += a->dropped;
+      if (a->out == NULL)
+      {
+        left += a->departed;
+      }
+      else
+      {
+        vehicleSec += a->out->carried * (GRID_TRAVEL / 1000.0);
+        dropped += a->out->dropped;
+      }
+    }
+  }
+  printf("%7d %8.2f %12.0f %7.2f %7u %9.0f %8.2f %7llu\n", threads, wall, vehicleSec / wall,
+         (base > 0) ? base / wall : 1.0, Pool_Steals(&pool), (double)left / hours,
+         departed ? delay / departed / 1000 : 0, (unsigned long long)dropped);
+  Pool_Stop(&pool);
+  return wall;
+}
+
+int main(int argc, char **argv)
+{
+  int side = (argc > 1) ? atoi(argv[1]) : 64;
+  uint32_t hours = (argc > 2) ? (uint32_t)atoi(argv[2]) : 1;
+  int threads = (argc > 3) ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t seed = (argc > 4) ? (uint32_t)atoi(argv[4]) : 1;
+  grid_t grid;
+  double base, wall;
+  int t;
+  if ((side < 2) || (side > 256) || (hours == 0) || (hours > 1000) || (threads < 1) ||
+      (threads > POOL_MAXTHREADS) || (seed == 0))
+  {
+    printf("usage: grid [side 2-256] [hours 1-1000] [threads 1-%d] [seed nonzero]\n",
+           POOL_MAXTHREADS);
+    return 1;
+  }
+  grid.side = side;
+  grid.node = calloc((size_t)side * side, sizeof(gridNode_t));
+  if (grid.node == NULL)
+  {
+    printf("out of memory\n");
+    return 1;
+  }
+  printf("%dx%d grid, %d controllers, %u h simulated, seed %u\n", side, side, side * side, hours,
+         seed);
+  printf("%7s %8s %12s %7s %7s %9s %8s %7s\n", "threads", "wall s", "veh-s/s", "speedup", "steals",
+         "exits/h", "delay s", "dropped");
+  base = 0;
+  for (t = 1; t <= threads; t = (t * 2 > threads && t < threads) ? threads : t * 2)
+  {
+    wall = gridrun(&grid, t, hours, seed, base);
+    if (t == 1)
+    {
+      base = wall;
+    }
+  }
+  free(grid.node);
+  return 0;
+}
@@ -0,0 +1,204 @@
+// pool.c
+// Runs on a Linux host
+// Work-stealing thread pool, see pool.h.
+
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+#include "pool.h"
+
+#define pack(first, end) (((uint64_t)(end) << 32) | (first))
+#define first(r) ((uint32_t)(r))
+#define end(r) ((uint32_t)((r) >> 32))
+
+// take the next task of a thread's own range
+static int take(poolWorker_t *w, uint32_t *task)
+{
+  uint64_t r = __atomic_load_n(&w->range, __ATOMIC_ACQUIRE);
+  while (first(r) < end(r))
+  { // on failure r is reloaded
+    if (__atomic_compare_exchange_n(&w->range, &r, pack(first(r) + 1, end(r)), 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      *task = first(r);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// move the back half of some other thread's range to w
+static int steal(pool_t *p, poolWorker_t *w)
+{
+  poolWorker_t *victim;
+  uint64_t r;
+  uint32_t half;
+  int i;
+  for (i = 1; i < p->threads; i++)
+  {
+    victim = &p->worker[(w->id + i) % p->threads];
+    r = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+    while (first(r) < end(r))
+    {
+      half = (end(r) - first(r) + 1) / 2;
+      if (__atomic_compare_exchange_n(&victim->range, &r, pack(first(r), end(r) - half), 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      { // w's own range is empty, so nobody else is changing it
+        __atomic_store_n(&w->range, pack(end(r) - half, end(r)), __ATOMIC_RELEASE);
+        w->steals++;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// run tasks until every task of this run has finished
+static void work(pool_t *p, poolWorker_t *w)
+{
+  uint32_t task;
+  while (__atomic_load_n(&p->remaining, __ATOMIC_ACQUIRE))
+  {
+    if (take(w, &task))
+    {
+      p->fn(p->arg, task);
+      __atomic_sub_fetch(&p->remaining, 1, __ATOMIC_ACQ_REL);
+    }
+    else if (!steal(p, w))
+    { // the last tasks are running elsewhere
+      sched_yield();
+    }
+  }
+}
+
+static void *workerthread(void *arg)
+{
+  poolWorker_t *w = arg;
+  pool_t *p = w->pool;
+  uint32_t seen = 0;
+  for (;;)
+  {
+    pthread_mutex_lock(&p->lock);
+    while ((p->generation == seen) && !p->stop)
+    {
+      pthread_cond_wait(&p->start, &p->lock);
+    }
+    seen = p->generation;
+    pthread_mutex_unlock(&p->lock);
+    if (p->stop)
+    {
+      return NULL;
+    }
+    work(p, w);
+    pthread_mutex_lock(&p->lock);
+    if (++p->finished == p->threads - 1)
+    {
+      pthread_cond_signal(&p->done);
+    }
+    pthread_mutex_unlock(&p->lock);
+  }
+}
+
+// ******** Pool_Init ************
+// Start the worker threads
+// Inputs:  p is the pool, which must stay allocated
+//          threads is the number of threads including the caller
+// Outputs: 1 if successful, 0 if threads is out of range or one
+//          could not be created
+int Pool_Init(pool_t *p, int threads)
+{
+  int i;
+  if ((threads < 1) || (threads > POOL_MAXTHREADS))
+  {
+    return 0;
+  }
+  p->threads = 1;
+  p->generation = 0;
+  p->stop = 0;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->start, NULL);
+  pthread_cond_init(&p->done, NULL);
+  for (i = 0; i < threads; i++)
+  {
+    p->worker[i].range = 0;
+    p->worker[i].steals = 0;
+    p->worker[i].pool = p;
+    p->worker[i].id = i;
+    if ((i > 0) && pthread_create(&p->worker[i].thread, NULL, &workerthread, &p->worker[i]))
+    {
+      Pool_Stop(p);
+      return 0;
+    }
+    p->threads = i + 1;
+  }
+  return 1;
+}
+
+// ******** Pool_Run ************
+// Run fn(arg, task) for every task from 0 to tasks-1 and wait
+// Inputs:  p is the pool
+//          tasks is the number of tasks
+//          fn is the task function, called on any thread
+//          arg is passed to fn
+// Outputs: none
+void Pool_Run(pool_t *p, uint32_t tasks, poolTask_t fn, void *arg)
+{
+  int i;
+  if (tasks == 0)
+  {
+    return;
+  }
+  for (i = 0; i < p->threads; i++)
+  { // even shares to start with
+    p->worker[i].range = pack((uint64_t)tasks * i / p->threads,
+                              (uint64_t)tasks * (i + 1) / p->threads);
+  }
+  p->fn = fn;
+  p->arg = arg;
+  p->remaining = tasks;
+  pthread_mutex_lock(&p->lock);
+  p->finished = 0;
+  p->generation++;
+  pthread_cond_broadcast(&p->start);
+  pthread_mutex_unlock(&p->lock);
+  work(p, &p->worker[0]);
+  pthread_mutex_lock(&p->lock);
+  while (p->finished < p->threads - 1)
+  { // no worker may still be looking at this run's ranges
+    pthread_cond_wait(&p->done, &p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+// ******** Pool_Steals ************
+// Ranges stolen by all threads since Pool_Init
+// Inputs:  p is the pool
+// Outputs: number of steals
+uint32_t Pool_Steals(const pool_t *p)
+{
+  uint32_t steals = 0;
+  int i;
+  for (i = 0; i < p->threads; i++)
+  {
+    steals += p->worker[i].steals;
+  }
+  return steals;
+}
+
+// ******** Pool_Stop ************
+// Stop and join the worker threads
+// Inputs:  p is the pool
+// Outputs: none
+void Pool_Stop(pool_t *p)
+{
+  int i;
+  pthread_mutex_lock(&p->lock);
+  p->stop = 1;
+  pthread_cond_broadcast(&p->start);
+  pthread_mutex_unlock(&p->lock);
+  for (i = 1; i < p->threads; i++)
+  {
+    pthread_join(p->worker[i].thread, NULL);
+  }
+  p->threads = 1;
+}
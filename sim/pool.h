@@ -0,0 +1,71 @@
+// pool.h
+// Runs on a Linux host
+// Work-stealing thread pool for the network simulators.  Pool_Run
+// splits tasks 0 to n-1 evenly between the threads; each thread takes
+// tasks from the front of its own range, and a thread that runs out
+// steals the back half of another thread's range.  A range is one
+// 64-bit word changed only by compare-and-swap, so taking and stealing
+// need no lock.  The calling thread works as thread 0.
+
+#ifndef POOL_H
+#define POOL_H
+#include <stdint.h>
+#include <pthread.h>
+
+#define POOL_MAXTHREADS 64
+
+typedef void (*poolTask_t)(void *arg, uint32_t task);
+
+typedef struct
+{
+  uint64_t range;   // next task in the low word, one past the last in the high word
+  uint32_t steals;  // ranges this thread has stolen
+  struct pool *pool;
+  int id;
+  pthread_t thread;
+} __attribute__((aligned(64))) poolWorker_t; // one cache line each
+
+typedef struct pool
+{
+  poolWorker_t worker[POOL_MAXTHREADS];
+  int threads;
+  poolTask_t fn;
+  void *arg;
+  uint32_t remaining;  // tasks not finished in this run
+  uint32_t generation; // counts runs, a change starts the workers
+  int finished;        // workers done with this run
+  int stop;
+  pthread_mutex_t lock;
+  pthread_cond_t start, done;
+} pool_t;
+
+// ******** Pool_Init ************
+// Start the worker threads
+// Inputs:  p is the pool, which must stay allocated
+//          threads is the number of threads including the caller
+// Outputs: 1 if successful, 0 if threads is out of range or one
+//          could not be created
+int Pool_Init(pool_t *p, int threads);
+
+// ******** Pool_Run ************
+// Run fn(arg, task) for every task from 0 to tasks-1 and wait
+// Inputs:  p is the pool
+//          tasks is the number of tasks
+//          fn is the task function, called on any thread
+//          arg is passed to fn
+// Outputs: none
+void Pool_Run(pool_t *p, uint32_t tasks, poolTask_t fn, void *arg);
+
+// ******** Pool_Steals ************
+// Ranges stolen by all threads since Pool_Init
+// Inputs:  p is the pool
+// Outputs: number of steals
+uint32_t Pool_Steals(const pool_t *p);
+
+// ******** Pool_Stop ************
+// Stop and join the worker threads
+// Inputs:  p is the pool
+// Outputs: none
+void Pool_Stop(pool_t *p);
+
+#endif
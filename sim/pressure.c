@@ -0,0 +1,195 @@
+// pressure.c
+// Runs on a Linux host
+// Compares fixed-time control with max pressure on a city grid where
+// the East-West streets carry more traffic than a fixed 50/50 split
+// can serve.  Each intersection has one signal group per direction of
+// travel, so the queue a group's cars join next is the same group of
+// the next intersection.  Three runs on the same random traffic:
+//   fixed     30 s for each axis
+//   queue     max pressure on its own queues only, 5 s slots
+//   pressure  max pressure less the cars on the road ahead and queued
+//             at its end, 5 s slots
+// Build and run from the top of the repository:
+//   gcc -O2 -o pressure sim/pressure.c sim/sim.c sim/stubs.c traffic.c
+//   ./pressure [side] [hours] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "sim.h"
+
+#define PRESSURE_MAX 16  // intersections on a side
+#define TRAVEL 15000     // ms per block
+#define STORAGE 28       // cars one lane of a block holds, 210 m at 7.5 m each
+#define PERIOD (TRAVEL / SIM_STEP) // steps per exchange period
+
+// approaches and groups by direction of travel
+enum { NORTHBOUND, SOUTHBOUND, EASTBOUND, WESTBOUND };
+static const int ApproachGroup[4] = {NORTHBOUND, SOUTHBOUND, EASTBOUND, WESTBOUND};
+static const uint32_t EdgeRate[4] = {200, 200, 850, 850}; // cars per hour entering
+static const int DX[4] = {0, 0, 1, -1};
+static const int DY[4] = {-1, 1, 0, 0};
+
+static const trafficGroup_t Groups[4] = {
+    {{NULL, NULL}, {0, 0}, {0, 0}},
+    {{NULL, NULL}, {0, 0}, {0, 0}},
+    {{NULL, NULL}, {0, 0}, {0, 0}},
+    {{NULL, NULL}, {0, 0}, {0, 0}},
+};
+static const trafficPhase_t FixedPhases[2] = {
+    {0x03, 30000, 0, 0, 3000, 1000}, // North-South 30 s, yellow 3 s, all-red 1 s
+    {0x0C, 30000, 0, 0, 3000, 1000}, // East-West 30 s
+};
+static const trafficPhase_t SlotPhases[2] = {
+    {0x03, 5000, 0, 0, 3000, 1000}, // decided again every 5 s
+    {0x0C, 5000, 0, 0, 3000, 1000},
+};
+static const trafficLayout_t Fixed = {Groups, 4, FixedPhases, 2};
+static const trafficLayout_t Slots = {Groups, 4, SlotPhases, 2};
+
+typedef struct
+{
+  simIntersection_t sim;
+  trafficCtrl_t ctrl;
+  TrafficLightPair lights[4];
+  simLink_t out[4];          // roads leaving, by direction of travel
+  int load[4];               // cars on the road and queued at its end, by group
+  const int *downstream[4];  // load, or NULL at the edge of the grid
+} pressureNode_t;
+
+static pressureNode_t Node[PRESSURE_MAX * PRESSURE_MAX];
+static int Side, NumNodes;
+
+// build the grid, every run has the same traffic
+static int gridinit(const trafficLayout_t *layout, int mode, uint32_t seed)
+{
+  pressureNode_t *n, *to;
+  uint32_t rates[4];
+  int i, d, x, y;
+  for (i = 0; i < NumNodes; i++)
+  {
+    n = &Node[i];
+    for (d = 0; d < 4; d++)
+    { // only the edges have traffic of their own
+      x = i % Side - DX[d];
+      y = i / Side - DY[d];
+      rates[d] = ((x < 0) || (x >= Side) || (y < 0) || (y >= Side)) ? EdgeRate[d] : 0;
+      n->downstream[d] = NULL;
+    }
+    if (!Traffic_Init(&n->ctrl, layout, n->lights, 0, 0) ||
+        !Sim_Init(&n->sim, &n->ctrl, NULL, ApproachGroup, rates, 4, seed + i))
+    {
+      return 0;
+    }
+  }
+  for (i = 0; i < NumNodes; i++)
+  {
+    n = &Node[i];
+    for (d = 0; d < 4; d++)
+    {
+      x = i % Side + DX[d];
+      y = i / Side + DY[d];
+      if ((x >= 0) && (x < Side) && (y >= 0) && (y < Side))
+      {
+        to = &Node[y * Side + x];
+        Sim_Connect(&n->sim, d, &n->out[d], TRAVEL, &to->sim, d);
+        n->out[d].storage = STORAGE;
+        n->load[d] = 0;
+        n->downstream[d] = &n->load[d];
+      }
+    }
+    if (mode)
+    {
+      Traffic_SetPressure(&n->ctrl, 1, (mode == 2) ? n->downstream : NULL);
+    }
+  }
+  return 1;
+}
+
+// what the cars of each group join downstream: the cars still on
+// the road as well as the queue at its end, or the controller sees
+// an empty block behind a platoon that is about to fill it
+static void loads(pressureNode_t *n)
+{
+  simLink_t *l;
+  int d;
+  for (d = 0; d < 4; d++)
+  {
+    if (n->downstream[d] != NULL)
+    {
+      l = &n->out[d];
+      n->load[d] = *l->queued + l->count + l->numSent[0] + l->numSent[1];
+    }
+  }
+}
+
+static void run(const char *name, const trafficLayout_t *layout, int mode, uint32_t hours,
+                uint32_t seed)
+{
+  uint32_t periods = hours * (3600000 / TRAVEL), p, step;
+  uint64_t left = 0, departed = 0, queued = 0, waiting = 0;
+  double delay = 0;
+  simApproach_t *a;
+  int i, d;
+  if (!gridinit(layout, mode, seed))
+  {
+    printf("%s: bad layout\n", name);
+    return;
+  }
+  for (p = 0; p < periods; p++)
+  {
+    for (i = 0; i < NumNodes; i++)
+    {
+      Sim_Receive(&Node[i].sim);
+      for (step = 0; step < PERIOD; step++)
+      {
+        loads(&Node[i]);
+        Sim_Step(&Node[i].sim);
+      }
+    }
+  }
+  for (i = 0; i < NumNodes; i++)
+  {
+    for (d = 0; d < 4; d++)
+    {
+      a = &Node[i].sim.app[d];
+      departed += a->departed;
+      delay += a->totalDelay;
+      queued += a->queueSum;
+      waiting += a->count;
+      if (a->out == NULL)
+      {
+        left += a->departed;
+      }
+    }
+  }
+  printf("%-9s %9.1f %8.1f %8.1f %8llu\n", name, (double)left / hours,
+         departed ? delay / departed / 1000 : 0, (double)queued / Node[0].sim.steps,
+         (unsigned long long)waiting);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t hours, seed, demand = 0;
+  int d;
+  Side = (argc > 1) ? atoi(argv[1]) : 6;
+  hours = (argc > 2) ? (uint32_t)atoi(argv[2]) : 2;
+  seed = (argc > 3) ? (uint32_t)atoi(argv[3]) : 1;
+  if ((Side < 2) || (Side > PRESSURE_MAX) || (hours == 0) || (hours > 1000) || (seed == 0))
+  {
+    printf("usage: pressure [side 2-%d] [hours 1-1000] [seed nonzero]\n", PRESSURE_MAX);
+    return 1;
+  }
+  NumNodes = Side * Side;
+  for (d = 0; d < 4; d++)
+  {
+    demand += EdgeRate[d] * Side;
+  }
+  printf("%dx%d grid, demand %u cars/h, %u h simulated, seed %u\n", Side, Side, demand, hours,
+         seed);
+  printf("%-9s %9s %8s %8s %8s\n", "control", "exits/h", "delay s", "queued", "waiting");
+  run("fixed", &Fixed, 0, hours, seed);
+  run("queue", &Slots, 1, hours, seed);
+  run("pressure", &Slots, 2, hours, seed);
+  return 0;
+}
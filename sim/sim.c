@@ -0,0 +1,326 @@
+// sim.c
+// Runs on a Linux host
+// Traffic flow model around one traffic.c controller, see sim.h.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "sim.h"
+
+// xorshift32, repeatable and independent of the C library
+static uint32_t random32(uint32_t *state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+// ******** Sim_Init ************
+// Set up an intersection with an idle road around a controller; the
+// simulation starts at time 0
+// Inputs:  s is the intersection
+//          ctrl is a controller started with Traffic_Init at or before 0
+//          task is its event thread, or NULL to call Traffic_Run
+//          groups[i] is the signal group of approach i
+//          rates[i] is the arrival rate of approach i, cars per hour
+//          n is the number of approaches
+//          seed picks the random arrivals, nonzero
+// Outputs: 1 if successful, 0 if the counts are invalid
+int Sim_Init(simIntersection_t *s, trafficCtrl_t *ctrl, void (*task)(void), const int *groups,
+             const uint32_t *rates, int n, uint32_t seed)
+{
+  simApproach_t *a;
+  int i, g;
+  if ((n <= 0) || (n > SIM_MAXAPPROACHES) || (seed == 0))
+  {
+    return 0;
+  }
+  s->ctrl = ctrl;
+  s->task = task;
+  s->now = 0;
+  s->next = ctrl->next;
+  s->rng = seed;
+  s->steps = 0;
+  s->side = 0;
+  if (task != NULL)
+  { // as if added with OS_AddPeriodicEventThread to run at the first change
+    SimTime = s->now;
+    SimNext = ctrl->next;
+  }
+  s->numApproaches = n;
+  for (i = 0; i < n; i++)
+  {
+    a = &s->app[i];
+    a->group = groups[i];
+    a->rate = rates[i];
+    a->in = a->out = NULL;
+    a->head = a->count = 0;
+    a->nextDepart = 0;
+    a->last = RED;
+    a->arrived = a->departed = a->dropped = 0;
+    a->totalDelay = 0;
+    for (g = 0; g < SIM_HISTBINS; g++)
+    {
+      a->hist[g] = 0;
+    }
+    a->queueSum = 0;
+    a->maxQueue = 0;
+  }
+  return 1;
+}
+
+// ******** Sim_Connect ************
+// Join an approach of one intersection to an approach of the next
+// Inputs:  from is the upstream intersection, a its approach
+//          link is the road, which must stay allocated
+//          travel is the time from stop line to stop line in ms
+//          to is the downstream intersection, b its approach
+// Outputs: none
+// A road with storage set afterwards holds back cars while it is
+// full; the upstream end then reads the downstream queue, so both
+// intersections must be stepped on the same thread
+void Sim_Connect(simIntersection_t *from, int a, simLink_t *link, uint32_t travel,
+                 simIntersection_t *to, int b)
+{
+  link->travel = travel;
+  link->numSent[0] = link->numSent[1] = 0;
+  link->head = link->count = 0;
+  link->carried = link->dropped = 0;
+  link->storage = 0;
+  link->queued = &to->app[b].count;
+  from->app[a].out = link;
+  to->app[b].in = link;
+}
+
+// ******** Sim_Receive ************
+// Start an exchange period: put the cars sent to this intersection
+// during the last one on their roads
+// Every intersection must have finished the last period first
+// Inputs:  s is the intersection
+// Outputs: none
+void Sim_Receive(simIntersection_t *s)
+{
+  simLink_t *l;
+  uint32_t i;
+  int a;
+  s->side ^= 1; // the upstream end now writes the other half
+  for (a = 0; a < s->numApproaches; a++)
+  {
+    if ((l = s->app[a].in) == NULL)
+    {
+      continue;
+    }
+    for (i = 0; i < l->numSent[s->side ^ 1]; i++)
+    {
+      if (l->count < SIM_LINKSIZE)
+      {
+        l->road[(l->head + l->count) & (SIM_LINKSIZE - 1)] = l->sent[s->side ^ 1][i];
+        l->count++;
+      }
+      else
+      {
+        l->dropped++;
+      }
+    }
+    l->numSent[s->side ^ 1] = 0;
+  }
+}
+
+// a car joins the back of the queue and trips the detector
+static void arrive(simIntersection_t *s, simApproach_t *a)
+{
+  a->arrived++;
+  if (a->count < SIM_QUEUESIZE)
+  {
+    a->queue[(a->head + a->count) & (SIM_QUEUESIZE - 1)] = s->now;
+    a->count++;
+  }
+  else
+  {
+    a->dropped++;
+  }
+  Traffic_Detect(s->ctrl, a->group, s->now);
+}
+
+// ******** Sim_Step ************
+// Advance the intersection by SIM_STEP ms
+// Inputs:  s is the intersection
+// Outputs: none
+void Sim_Step(simIntersection_t *s)
+{
+  simApproach_t *a;
+  simLink_t *l;
+  TrafficLightState state;
+  uint32_t delay;
+  int i;
+  s->now += SIM_STEP;
+  s->steps++;
+  if (s->task != NULL)
+  { // the firmware event thread, released by its own OS_ReleaseIn
+    SimTime = s->now;
+    if ((int32_t)(s->now - SimNext) >= 0)
+    {
+      s->task();
+    }
+  }
+  else if ((int32_t)(s->now - s->next) >= 0)
+  {
+    s->next = Traffic_Run(s->ctrl, s->now);
+  }
+  for (i = 0; i < s->numApproaches; i++)
+  {
+    a = &s->app[i];
+    if ((l = a->in) != NULL)
+    { // cars from upstream that have reached the end of the road
+      while (l->count && ((int32_t)(s->now - l->road[l->head]) >= 0))
+      {
+        l->head = (l->head + 1) & (SIM_LINKSIZE - 1);
+        l->count--;
+        arrive(s, a);
+      }
+    }
+    // arrivals, Bernoulli per step approximates Poisson at these rates
+    else if ((uint64_t)random32(&s->rng) * 3600000 < (uint64_t)a->rate * SIM_STEP * 0xFFFFFFFFu)
+    {
+      arrive(s, a);
+    }
+    // departures, none on yellow
+    state = s->ctrl->lights[a->group].state;
+    if ((state == GREEN) && (a->last != GREEN) && ((int32_t)(s->now + SIM_STARTUP - a->nextDepart) > 0))
+    {
+      a->nextDepart = s->now + SIM_STARTUP; // the queue has to get moving
+    }
+    a->last = state;
+    l = a->out;
+    if ((state == GREEN) && a->count && ((int32_t)(s->now - a->nextDepart) >= 0) &&
+        ((l == NULL) || (l->storage == 0) ||
+         (*l->queued + l->count + l->numSent[0] + l->numSent[1] < l->storage)))
+    { // the next road has room
+      delay = s->now - a->queue[a->head];
+      a->head = (a->head + 1) & (SIM_QUEUESIZE - 1);
+      a->count--;
+      a->departed++;
+      a->totalDelay += delay;
+      a->hist[(delay / 1000 < SIM_HISTBINS) ? delay / 1000 : SIM_HISTBINS - 1]++;
+      a->nextDepart = s->now + SIM_HEADWAY;
+      Traffic_Leave(s->ctrl, a->group);
+      if (l != NULL)
+      { // on to the next intersection
+        if (l->numSent[s->side] < SIM_LINKSIZE)
+        {
+          l->sent[s->side][l->numSent[s->side]++] = s->now + l->travel;
+          l->carried++;
+        }
+        else
+        {
+          l->dropped++;
+        }
+      }
+    }
+    a->queueSum += a->count;
+    if (a->count > a->maxQueue)
+    {
+      a->maxQueue = a->count;
+    }
+  }
+}
+
+// first and one past the last approach to add up
+#define first(s, a) (((a) < 0) ? 0 : (a))
+#define last(s, a) (((a) < 0) ? (s)->numApproaches : (a) + 1)
+
+// ******** Sim_Throughput ************
+// Cars that left, per hour of simulated time
+// Inputs:  s is the intersection
+//          a is the approach, -1 for all of them
+// Outputs: cars per hour
+double Sim_Throughput(const simIntersection_t *s, int a)
+{
+  uint32_t departed = 0;
+  int i;
+  for (i = first(s, a); i < last(s, a); i++)
+  {
+    departed += s->app[i].departed;
+  }
+  return s->steps ? departed * 3600000.0 / ((double)s->steps * SIM_STEP) : 0;
+}
+
+// ******** Sim_MeanDelay ************
+// Average time a departed car waited at the stop line
+// Inputs:  s is the intersection
+//          a is the approach, -1 for all of them
+// Outputs: seconds
+double Sim_MeanDelay(const simIntersection_t *s, int a)
+{
+  uint32_t departed = 0;
+  double delay = 0;
+  int i;
+  for (i = first(s, a); i < last(s, a); i++)
+  {
+    departed += s->app[i].departed;
+    delay += s->app[i].totalDelay;
+  }
+  return departed ? delay / departed / 1000 : 0;
+}
+
+// ******** Sim_P95Delay ************
+// Delay that 95% of departed cars did not exceed
+// Inputs:  s is the intersection
+//          a is the approach, -1 for all of them
+// Outputs: seconds, rounded up to a whole second
+uint32_t Sim_P95Delay(const simIntersection_t *s, int a)
+{
+  uint64_t departed = 0, seen = 0;
+  uint32_t bin;
+  int i;
+  for (i = first(s, a); i < last(s, a); i++)
+  {
+    departed += s->app[i].departed;
+  }
+  if (departed == 0)
+  {
+    return 0;
+  }
+  for (bin = 0; bin < SIM_HISTBINS; bin++)
+  {
+    for (i = first(s, a); i < last(s, a); i++)
+    {
+      seen += s->app[i].hist[bin];
+    }
+    if (seen * 100 >= departed * 95)
+    {
+      break;
+    }
+  }
+  return bin + 1;
+}
+
+// ******** Sim_Report ************
+// Print the statistics of every approach and the total
+// Inputs:  s is the intersection
+//          names[i] names approach i
+//          out is where to print
+// Outputs: none
+void Sim_Report(const simIntersection_t *s, const char *const *names, FILE *out)
+{
+  const simApproach_t *ap;
+  uint64_t queueSum = 0;
+  uint32_t waiting = 0;
+  int a;
+  fprintf(out, "%-8s %8s %8s %8s %8s %8s %8s\n", "approach", "cars/h", "delay s", "p95 s",
+          "queue", "max q", "waiting");
+  for (a = 0; a < s->numApproaches; a++)
+  {
+    ap = &s->app[a];
+    fprintf(out, "%-8s %8.1f %8.1f %8u %8.2f %8u %8u\n", names[a], Sim_Throughput(s, a),
+            Sim_MeanDelay(s, a), Sim_P95Delay(s, a),
+            s->steps ? (double)ap->queueSum / s->steps : 0, ap->maxQueue, ap->count);
+    queueSum += ap->queueSum;
+    waiting += ap->count;
+  }
+  fprintf(out, "%-8s %8.1f %8.1f %8u %8.2f %8s %8u\n", "total", Sim_Throughput(s, -1),
+          Sim_MeanDelay(s, -1), Sim_P95Delay(s, -1), s->steps ? (double)queueSum / s->steps : 0,
+          "-", waiting);
+}
@@ -0,0 +1,157 @@
+// sim.h
+// Runs on a Linux host
+// Traffic flow model around one traffic.c controller.  Each approach
+// is a lane feeding one signal group: cars arrive at random, trip the
+// group's detector, queue at the stop line and leave one per
+// saturation headway while the group is green.  Time is in ticks
+// (msec) like the controller, advanced SIM_STEP at a time.
+//
+// The controller is either run directly with Traffic_Run, or through
+// its firmware event thread (SwitchTrafficLightTask) with OS time and
+// OS_ReleaseIn supplied by stubs.c.
+//
+// Intersections can be joined by road links into a network.  Cars a
+// link carries during one exchange period reach the downstream end
+// only in the next one, so as long as the period is no longer than
+// the travel time, every intersection can be stepped through a period
+// on its own thread.  The sizes below may be overridden on the
+// command line to fit thousands of intersections in memory.
+
+#ifndef SIM_H
+#define SIM_H
+#include <stdio.h>
+#include <stdint.h>
+#include "../traffic.h"
+
+#define SIM_STEP 100          // ms per simulation step
+#define SIM_HEADWAY 2000      // ms between departures from a green queue
+#define SIM_STARTUP 1000      // ms from green to the first departure
+#ifndef SIM_MAXAPPROACHES
+#define SIM_MAXAPPROACHES 16
+#endif
+#ifndef SIM_QUEUESIZE
+#define SIM_QUEUESIZE 4096    // cars waiting on one approach, must be a power of 2
+#endif
+#ifndef SIM_HISTBINS
+#define SIM_HISTBINS 600      // delay histogram, 1 s bins, the last one catches the rest
+#endif
+#define SIM_LINKSIZE 64       // cars on one road link, must be a power of 2
+
+// a road from the stop line of one intersection to the next
+typedef struct
+{
+  uint32_t travel;                // ms between the two stop lines
+  uint32_t sent[2][SIM_LINKSIZE]; // arrival times, written upstream, by period parity
+  uint32_t numSent[2];
+  uint32_t road[SIM_LINKSIZE];    // arrival times of the cars on the road, read downstream
+  uint32_t head, count;
+  uint32_t carried, dropped;
+  uint32_t storage;               // cars the road and the queue at its end hold, 0 for no limit
+  const uint32_t *queued;         // cars queued at the end of the road
+} simLink_t;
+
+typedef struct
+{
+  int group;           // signal group that controls this approach
+  uint32_t rate;       // cars per hour, when no link feeds it
+  simLink_t *in;       // road bringing cars from upstream, or NULL
+  simLink_t *out;      // road taking departed cars downstream, or NULL
+  uint32_t queue[SIM_QUEUESIZE]; // arrival times of the waiting cars
+  uint32_t head, count;
+  uint32_t nextDepart; // earliest time the next car may leave
+  TrafficLightState last;
+  uint32_t arrived, departed, dropped;
+  double totalDelay;   // ms, summed over departed cars
+  uint32_t hist[SIM_HISTBINS]; // departed cars by delay in whole seconds
+  uint64_t queueSum;   // queue length summed over steps
+  uint32_t maxQueue;
+} simApproach_t;
+
+typedef struct
+{
+  trafficCtrl_t *ctrl;
+  void (*task)(void); // event thread that runs ctrl, NULL to call Traffic_Run
+  simApproach_t app[SIM_MAXAPPROACHES];
+  int numApproaches;
+  uint32_t rng;  // random number state, same seed gives the same run
+  uint32_t now;  // ms
+  uint32_t next; // when the controller wants to run again
+  uint32_t steps;
+  int side;      // parity of the exchange period, see Sim_Receive
+} simIntersection_t;
+
+// time and next release seen by the event thread, in stubs.c
+extern uint32_t SimTime;
+extern uint32_t SimNext;
+
+// ******** Sim_Init ************
+// Set up an intersection with an idle road around a controller; the
+// simulation starts at time 0
+// Inputs:  s is the intersection
+//          ctrl is a controller started with Traffic_Init at or before 0
+//          task is its event thread, or NULL to call Traffic_Run
+//          groups[i] is the signal group of approach i
+//          rates[i] is the arrival rate of approach i, cars per hour
+//          n is the number of approaches
+//          seed picks the random arrivals, nonzero
+// Outputs: 1 if successful, 0 if the counts are invalid
+int Sim_Init(simIntersection_t *s, trafficCtrl_t *ctrl, void (*task)(void), const int *groups,
+             const uint32_t *rates, int n, uint32_t seed);
+
+// ******** Sim_Connect ************
+// Join an approach of one intersection to an approach of the next
+// Inputs:  from is the upstream intersection, a its approach
+//          link is the road, which must stay allocated
+//          travel is the time from stop line to stop line in ms
+//          to is the downstream intersection, b its approach
+// Outputs: none
+// A road with storage set afterwards holds back cars while it is
+// full; the upstream end then reads the downstream queue, so both
+// intersections must be stepped on the same thread
+void Sim_Connect(simIntersection_t *from, int a, simLink_t *link, uint32_t travel,
+                 simIntersection_t *to, int b);
+
+// ******** Sim_Receive ************
+// Start an exchange period: put the cars sent to this intersection
+// during the last one on their roads
+// Every intersection must have finished the last period first
+// Inputs:  s is the intersection
+// Outputs: none
+void Sim_Receive(simIntersection_t *s);
+
+// ******** Sim_Step ************
+// Advance the intersection by SIM_STEP ms
+// Inputs:  s is the intersection
+// Outputs: none
+void Sim_Step(simIntersection_t *s);
+
+// ******** Sim_Throughput ************
+// Cars that left, per hour of simulated time
+// Inputs:  s is the intersection
+//          a is the approach, -1 for all of them
+// Outputs: cars per hour
+double Sim_Throughput(const simIntersection_t *s, int a);
+
+// ******** Sim_MeanDelay ************
+// Average time a departed car waited at the stop line
+// Inputs:  s is the intersection
+//          a is the approach, -1 for all of them
+// Outputs: seconds
+double Sim_MeanDelay(const simIntersection_t *s, int a);
+
+// ******** Sim_P95Delay ************
+// Delay that 95% of departed cars did not exceed
+// Inputs:  s is the intersection
+//          a is the approach, -1 for all of them
+// Outputs: seconds, rounded up to a whole second
+uint32_t Sim_P95Delay(const simIntersection_t *s, int a);
+
+// ******** Sim_Report ************
+// Print the statistics of every approach and the total
+// Inputs:  s is the intersection
+//          names[i] names approach i
+//          out is where to print
+// Outputs: none
+void Sim_Report(const simIntersection_t *s, const char *const *names, FILE *out);
+
+#endif
@@ -0,0 +1,42 @@
+// stubs.c
+// Runs on a Linux host
+// The parts of the BSP and OS that traffic.c calls, so that it
+// links unchanged into the simulators.  The LCD is not drawn, OS
+// time is whatever the simulator sets SimTime to, and OS_ReleaseIn
+// leaves the release time in SimNext for the simulator to honour.
+
+#include <stdint.h>
+#include "../os.h"
+
+uint32_t SimTime; // ms, set by the simulator
+uint32_t SimNext; // ms, when the event thread asked to run next
+
+uint32_t BSP_LCD_DrawString(uint16_t x, uint16_t y, char *pt, int16_t textColor)
+{
+  (void)x;
+  (void)y;
+  (void)textColor;
+  return (pt == 0) ? 0 : 1;
+}
+
+uint32_t OS_Time(void)
+{
+  return SimTime;
+}
+
+long StartCritical(void)
+{
+  return 0;
+}
+
+void EndCritical(long sr)
+{
+  (void)sr;
+}
+
+int OS_ReleaseIn(void (*thread)(void), uint32_t delay)
+{
+  (void)thread;
+  SimNext = SimTime + delay;
+  return 1;
+}
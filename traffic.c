@@ -0,0 +1,1096 @@
+// traffic.c
+// Runs on LM4F120/TM4C123/MSP432, and on a host for simulation
+// Table-driven traffic signal controller, see traffic.h.
+
+#include <stdint.h>
+#include "os.h"
+#include "traffic.h"
+
+// index of the lowest set bit of a nonzero mask
+#if defined(__CC_ARM)
+#define lowestbit(m) __clz(__rbit(m))
+#else
+#define lowestbit(m) __builtin_ctz(m)
+#endif
+// a detector ISR may set a call while the controller clears another,
+// so on the target calls are cleared through the bit-band alias
+#if defined(__CC_ARM)
+#define clearcall(c, g) Flag_Clear((c)->calls, g)
+#define clearped(c, i) Flag_Clear((c)->pedCalls, i)
+#else
+#define clearcall(c, g) ((c)->calls &= ~(1u << (g)))
+#define clearped(c, i) ((c)->pedCalls &= ~(1u << (i)))
+#endif
+#define pedcalled(c, i) (((i) < 32) && ((c)->pedCalls & (1u << (i))))
+// the controller only marks what changed on the LCD and Traffic_Draw
+// draws it, so marks are set and cleared through the bit-band alias too
+#if defined(__CC_ARM)
+#define markgroup(c, g) Flag_Set((c)->staleGroups, g)
+#define unmarkgroup(c, g) Flag_Clear((c)->staleGroups, g)
+#else
+#define markgroup(c, g) ((c)->staleGroups |= 1u << (g))
+#define unmarkgroup(c, g) ((c)->staleGroups &= ~(1u << (g)))
+#endif
+
+// show the colour of one group on the LCD
+static void drawgroup(const trafficCtrl_t *c, int g)
+{
+  const trafficGroup_t *group = &c->layout->groups[g];
+  static const int16_t colors[3] = {LCD_RED, LCD_GREEN, LCD_YELLOW};
+  int16_t color = colors[c->lights[g].state];
+  int i;
+  for (i = 0; i < TRAFFIC_LABELS; i++)
+  {
+    if (group->label[i] != NULL)
+    {
+      BSP_LCD_DrawString(group->x[i], group->y[i], (char *)group->label[i], color);
+    }
+  }
+}
+
+// show the pedestrian signal on the LCD
+static void drawwalk(const trafficCtrl_t *c)
+{
+  static const char *const text[3] = {"DONT", "WALK", "DONT"};
+  static const int16_t colors[3] = {LCD_RED, LCD_WHITE, LCD_YELLOW};
+  BSP_LCD_DrawString(c->layout->walkX, c->layout->walkY, (char *)text[c->walk],
+                     colors[c->walk]);
+}
+
+// the pedestrian signal changed, Traffic_Draw shows it
+static void markwalk(trafficCtrl_t *c)
+{
+  if (c->display)
+  {
+    c->staleWalk = 1;
+  }
+}
+
+// start the walk of the current phase's crossing if it was called,
+// not while an emergency vehicle has the intersection
+static void startwalk(trafficCtrl_t *c, uint32_t at)
+{
+  if (pedcalled(c, c->phase) && (c->preempt == TRAFFIC_NOPREEMPT))
+  {
+    clearped(c, c->phase);
+    c->walk = TRAFFIC_WALK;
+    c->walkStart = at;
+    markwalk(c);
+  }
+}
+
+// set the groups in mask to state
+static void setgroups(trafficCtrl_t *c, uint32_t mask, TrafficLightState state)
+{
+  int g;
+  if (state == GREEN)
+  {
+    c->shown |= mask;
+  }
+  else
+  {
+    c->shown &= ~mask;
+  }
+  while (mask)
+  {
+    g = lowestbit(mask);
+    mask &= mask - 1;
+    c->lights[g].state = state;
+    if (state == GREEN)
+    { // its waiting cars are being served
+      c->lights[g].cars = 0;
+      clearcall(c, g);
+    }
+    if (c->display)
+    {
+      markgroup(c, g);
+    }
+  }
+}
+
+// phase after the current green: the next in turn, or under max
+// pressure the one with the most, the current one unless another
+// beats it by TRAFFIC_PRESSUREHOLD
+static uint8_t nextphase(const trafficCtrl_t *c)
+{
+  const trafficLayout_t *layout = c->layout;
+  int32_t pressure[TRAFFIC_MAXGROUPS], sum, best = 0;
+  uint32_t groups;
+  int g, i, choice = 0;
+  if (!c->pressure)
+  {
+    return (c->phase + 1 == layout->numPhases) ? 0 : c->phase + 1;
+  }
+  if (c->pedCalls)
+  { // a waiting pedestrian goes first
+    return lowestbit(c->pedCalls);
+  }
+  for (g = 0; g < layout->numGroups; g++)
+  { // once per group, phases often share groups
+    pressure[g] = c->lights[g].queue;
+    if ((c->downstream != NULL) && (c->downstream[g] != NULL))
+    {
+      pressure[g] -= *c->downstream[g];
+    }
+    if (pressure[g] < 0)
+    { // green would move no cars, or fill the road ahead
+      pressure[g] = 0;
+    }
+  }
+  for (i = 0; i < layout->numPhases; i++)
+  {
+    sum = 0;
+    groups = layout->phases[i].green;
+    while (groups)
+    {
+      sum += pressure[lowestbit(groups)];
+      groups &= groups - 1;
+    }
+    if (i == c->phase)
+    {
+      sum += TRAFFIC_PRESSUREHOLD;
+    }
+    if ((i == 0) || (sum > best) || ((sum == best) && (i == c->phase)))
+    {
+      best = sum;
+      choice = i;
+    }
+  }
+  return choice;
+}
+
+// time of the week on the shared clock at local time t, from the
+// position taken at c->clockAt; t is less than 24 days either side
+static uint32_t weekat(const trafficCtrl_t *c, uint32_t t)
+{
+  uint32_t d;
+  if ((int32_t)(t - c->clockAt) >= 0)
+  {
+    d = (t - c->clockAt) % TRAFFIC_WEEK;
+    return (c->week + d) % TRAFFIC_WEEK; // less than 2 weeks, no overflow
+  }
+  d = (c->clockAt - t) % TRAFFIC_WEEK;
+  return (c->week + TRAFFIC_WEEK - d) % TRAFFIC_WEEK;
+}
+
+// move the week position up to now; the sum of the local time and
+// an offset would jump by 2^32 mod TRAFFIC_WEEK when local time wraps
+static void clockforward(trafficCtrl_t *c, uint32_t now)
+{
+  c->week = weekat(c, now);
+  c->clockAt = now;
+}
+
+// at the start of a cycle, switch to the calendar's plan for this
+// time of the week; the plans were checked by Traffic_Schedule, so a
+// change is a swap of the layout pointer and the offset
+static void planswap(trafficCtrl_t *c)
+{
+  const trafficCalendar_t *calendar = c->calendar;
+  const trafficPlan_t *plan = calendar->events[calendar->numEvents - 1].plan;
+  uint32_t week = weekat(c, c->start);
+  int i;
+  for (i = 0; (i < calendar->numEvents) && (calendar->events[i].at <= week); i++)
+  { // before the first event, last week's last plan is still in force
+    plan = calendar->events[i].plan;
+  }
+  if (plan != c->plan)
+  {
+    c->plan = plan;
+    c->layout = plan->layout;
+    c->offset = plan->offset;
+    c->cycle = (plan->offset == TRAFFIC_FREE) ? 0 : plan->cycle;
+  }
+}
+
+// a green starts at c->start; a coordinated controller works out at
+// the start of each cycle how far it is off its offset, and each green
+// makes up as much of that as it may
+static void startgreen(trafficCtrl_t *c)
+{
+  int32_t limit;
+  uint32_t late;
+  if ((c->phase == 0) && (c->calendar != NULL) && (c->preempt == TRAFFIC_NOPREEMPT))
+  {
+    planswap(c);
+  }
+  startwalk(c, c->start);
+  if ((c->phase == c->preempt) && ((int32_t)(c->start + c->preemptHold - c->preemptUntil) > 0))
+  { // the emergency green, held at least preemptHold
+    c->preemptUntil = c->start + c->preemptHold;
+  }
+  if ((c->cycle == 0) || (c->preempt != TRAFFIC_NOPREEMPT))
+  {
+    c->adjust = 0;
+    return;
+  }
+  if (c->phase == 0)
+  { // time since phase 0 should last have started
+    late = (weekat(c, c->start) + TRAFFIC_WEEK - c->offset) % c->cycle;
+    c->error = (late <= c->cycle / 2) ? (int32_t)late : (int32_t)late - (int32_t)c->cycle;
+  }
+  limit = c->layout->phases[c->phase].duration * TRAFFIC_CORRECT / 100;
+  c->adjust = (c->error > limit) ? limit : (c->error < -limit) ? -limit : c->error;
+  c->error -= c->adjust;
+}
+
+// shortest green of a phase run free, walk included
+static uint32_t shortest(const trafficPhase_t *p)
+{
+  uint32_t green = p->passage ? p->minGreen : p->duration;
+  if (p->walk && (p->walk + p->pedClear > green))
+  {
+    green = p->walk + p->pedClear;
+  }
+  return green;
+}
+
+// yellow and all-red after phase i, none if nothing stops
+static uint32_t clearance(const trafficLayout_t *layout, int i)
+{
+  const trafficPhase_t *p = &layout->phases[i];
+  const trafficPhase_t *next = &layout->phases[(i + 1 == layout->numPhases) ? 0 : i + 1];
+  return (p->green & ~next->green) ? p->yellow + p->allRed : 0;
+}
+
+// longest a pedestrian can wait: once round the cycle as short as it
+// goes, fixed greens maybe stretched by coordination
+static uint32_t pedworst(const trafficLayout_t *layout)
+{
+  const trafficPhase_t *p;
+  uint32_t worst = 0;
+  int i;
+  for (i = 0; i < layout->numPhases; i++)
+  {
+    p = &layout->phases[i];
+    worst += shortest(p) + clearance(layout, i);
+    if (p->passage == 0)
+    {
+      worst += p->duration * TRAFFIC_CORRECT / 100;
+    }
+  }
+  return worst;
+}
+
+// latest end of the current green that still reaches the crossing in
+// calls furthest round the cycle by the deadline, the phases in
+// between running their shortest greens
+static uint32_t pedlatest(const trafficCtrl_t *c, uint32_t calls)
+{
+  const trafficLayout_t *layout = c->layout;
+  uint32_t latest = c->pedDeadline - clearance(layout, c->phase);
+  int i, n, far = c->phase;
+  for (n = 1, i = c->phase; n <= layout->numPhases; n++)
+  {
+    i = (i + 1 == layout->numPhases) ? 0 : i + 1;
+    if ((i < 32) && (calls & (1u << i)))
+    {
+      far = i;
+    }
+  }
+  for (i = c->phase;;)
+  {
+    i = (i + 1 == layout->numPhases) ? 0 : i + 1;
+    if (i == far)
+    {
+      return latest;
+    }
+    latest -= shortest(&layout->phases[i]) + clearance(layout, i);
+  }
+}
+
+// end of an actuated green given the cars detected so far
+static uint32_t actuatedend(const trafficCtrl_t *c, uint32_t now)
+{
+  const trafficPhase_t *p = &c->layout->phases[c->phase];
+  uint32_t end, last, groups, latest;
+  int g;
+  end = c->start + p->minGreen;
+  groups = p->green;
+  while (groups)
+  { // extend past the last car seen this green
+    g = lowestbit(groups);
+    groups &= groups - 1;
+    last = (uint32_t)c->lights[g].timer;
+    if (((int32_t)(last - c->start) > 0) && ((int32_t)(last + p->passage - end) > 0))
+    {
+      end = last + p->passage;
+    }
+  }
+  if (((c->calls & ~p->green) == 0) && (c->pedCalls == 0))
+  { // nobody else waiting, rest in green and look again later
+    if ((int32_t)(end - now) <= 0)
+    {
+      end = now + p->passage;
+    }
+    return end;
+  }
+  if ((int32_t)(end - (c->start + p->duration)) > 0)
+  {
+    end = c->start + p->duration; // max out
+  }
+  if (c->pedCalls && c->pedMaxWait)
+  { // force off in time for a waiting pedestrian, but not before the minimum
+    latest = pedlatest(c, c->pedCalls);
+    if ((int32_t)(latest - (c->start + p->minGreen)) < 0)
+    {
+      latest = c->start + p->minGreen;
+    }
+    if ((int32_t)(end - latest) > 0)
+    {
+      end = latest;
+    }
+  }
+  return end;
+}
+
+// time the current interval ends, for a green given the cars detected so far
+static uint32_t intervalend(const trafficCtrl_t *c, uint32_t now)
+{
+  const trafficPhase_t *p = &c->layout->phases[c->phase];
+  uint32_t end, walked;
+  if (c->interval != TRAFFIC_GREEN)
+  { // nothing to clear if every group stays green
+    if (c->clearing == 0)
+    {
+      return c->start;
+    }
+    return c->start + ((c->interval == TRAFFIC_YELLOW) ? p->yellow : p->allRed);
+  }
+  if (c->preempt != TRAFFIC_NOPREEMPT)
+  { // held for an emergency vehicle, or in its way
+    end = (c->phase == c->preempt) ? c->preemptUntil : now;
+  }
+  else if (c->cycle || c->pressure)
+  { // coordinated, the split less any correction; or one max pressure slot
+    end = c->start + p->duration - c->adjust;
+  }
+  else if (p->passage == 0)
+  {
+    end = c->start + p->duration; // fixed time
+  }
+  else
+  {
+    end = actuatedend(c, now);
+  }
+  if (c->walk != TRAFFIC_DONTWALK)
+  { // the crossing clears before the green ends
+    walked = c->walkStart + p->walk + p->pedClear;
+    if ((int32_t)(walked - end) > 0)
+    {
+      end = walked;
+    }
+  }
+  walked = ((int32_t)(now - c->next) < 0) ? now : c->next;
+  if ((int32_t)(end - walked) < 0)
+  { // not before the controller last looked: a call that ends a rest,
+    // or a walk that held the green, ends it now and not in the past
+    end = walked;
+  }
+  return end;
+}
+
+// whether a walk started now would end before the current green has to
+static int walkfits(const trafficCtrl_t *c, uint32_t now)
+{
+  const trafficPhase_t *p = &c->layout->phases[c->phase];
+  uint32_t limit, others = c->pedCalls & ~(1u << c->phase), latest;
+  if (c->cycle || c->pressure || (p->passage == 0))
+  {
+    limit = intervalend(c, now); // fixed length
+  }
+  else if (((c->calls & ~p->green) == 0) && (others == 0))
+  {
+    return 1; // resting, nobody else is waiting
+  }
+  else
+  {
+    limit = c->start + p->duration; // max green
+    if (others && c->pedMaxWait)
+    { // nor hold up the other crossings
+      latest = pedlatest(c, others);
+      if ((int32_t)(latest - limit) < 0)
+      {
+        limit = latest;
+      }
+    }
+  }
+  return (int32_t)(now + p->walk + p->pedClear - limit) <= 0;
+}
+
+// an emergency vehicle needs c->preempt: a walk in its way is cut off
+// and a clearance under way goes to its phase instead, with a yellow
+// for any group the clearance was going to keep green; a green in
+// its way is ended by intervalend
+static void preemptnow(trafficCtrl_t *c, uint32_t now)
+{
+  uint32_t stop;
+  if ((c->phase == c->preempt) && (c->interval == TRAFFIC_GREEN))
+  {
+    return; // already has it
+  }
+  if (c->walk != TRAFFIC_DONTWALK)
+  {
+    c->walk = TRAFFIC_DONTWALK;
+    markwalk(c);
+  }
+  if ((c->interval == TRAFFIC_GREEN) || (c->target == c->preempt))
+  {
+    return;
+  }
+  c->target = c->preempt;
+  stop = c->shown & ~c->layout->phases[c->preempt].green;
+  if (stop)
+  { // the yellow starts again, all-red follows in full
+    setgroups(c, stop, YELLOW);
+    c->clearing |= stop;
+    c->interval = TRAFFIC_YELLOW;
+    c->start = now;
+  }
+}
+
+// whether the tables of a layout can be run
+static int validlayout(const trafficLayout_t *layout)
+{
+  const trafficPhase_t *p;
+  int i;
+  if ((layout->numGroups == 0) || (layout->numGroups > TRAFFIC_MAXGROUPS) ||
+      (layout->numPhases == 0))
+  {
+    return 0;
+  }
+  for (i = 0; i < layout->numPhases; i++)
+  { // every phase must take some time, or Traffic_Run could loop forever
+    p = &layout->phases[i];
+    if ((p->duration == 0) || (p->passage && (p->minGreen == 0)) ||
+        ((layout->numGroups < 32) && (p->green >> layout->numGroups)) ||
+        (p->walk && (p->passage == 0) && (p->walk + p->pedClear > p->duration)))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// ******** Traffic_Init ************
+// Start a controller in phase 0
+// Inputs:  c is the controller, which must stay allocated
+//          layout describes the intersection, at most TRAFFIC_MAXGROUPS groups
+//          lights is storage for the state of each group
+//          display is nonzero if this controller is drawn on the LCD,
+//          by Traffic_Draw
+//          now is the current time in ticks (msec)
+// Outputs: 1 if successful, 0 if the layout is invalid
+int Traffic_Init(trafficCtrl_t *c, const trafficLayout_t *layout, TrafficLightPair *lights,
+                 int display, uint32_t now)
+{
+  int g;
+  if (!validlayout(layout))
+  {
+    return 0;
+  }
+  c->layout = layout;
+  c->lights = lights;
+  c->display = display;
+  c->staleGroups = 0;
+  c->staleWalk = 0;
+  for (g = 0; g < layout->numGroups; g++)
+  {
+    lights[g].pair = g;
+    lights[g].state = RED;
+    lights[g].timer = 0;
+    lights[g].cars = 0;
+    lights[g].queue = 0;
+  }
+  c->calls = 0;
+  c->shown = 0;
+  c->clearing = 0;
+  c->phase = c->target = 0;
+  c->interval = TRAFFIC_GREEN;
+  c->start = c->next = now;
+  c->cycle = 0;
+  c->offset = TRAFFIC_FREE;
+  c->clockAt = now;
+  c->week = 0;
+  c->error = c->adjust = 0;
+  c->downstream = NULL;
+  c->pressure = 0;
+  c->pedCalls = 0;
+  c->pedMaxWait = 0;
+  c->walk = TRAFFIC_DONTWALK;
+  c->preempt = TRAFFIC_NOPREEMPT;
+  c->calendar = NULL;
+  c->plan = NULL;
+  for (g = 0; g < layout->numPhases; g++)
+  { // draw the pedestrian signal if there is a crossing
+    if (layout->phases[g].walk)
+    {
+      markwalk(c);
+      break;
+    }
+  }
+  // every group is drawn once, after that only changes are
+  setgroups(c, (layout->numGroups == 32) ? 0xFFFFFFFF : (1u << layout->numGroups) - 1, RED);
+  setgroups(c, layout->phases[0].green, GREEN);
+  startgreen(c);
+  c->next = intervalend(c, now);
+  return 1;
+}
+
+// ******** Traffic_SetPhase ************
+// Switch to a phase now, without yellow or all-red, for start-up or
+// tests; only groups whose colour changes are updated
+// Inputs:  c is the controller
+//          phase is the new phase, less than numPhases
+//          now is the current time in ticks (msec)
+// Outputs: none
+void Traffic_SetPhase(trafficCtrl_t *c, uint8_t phase, uint32_t now)
+{
+  const trafficPhase_t *p = &c->layout->phases[phase];
+  setgroups(c, c->clearing | (c->shown & ~p->green), RED);
+  setgroups(c, p->green & ~c->shown, GREEN);
+  c->clearing = 0;
+  c->phase = c->target = phase;
+  c->interval = TRAFFIC_GREEN;
+  c->start = c->next = now;
+  c->error = 0;
+  if (c->walk != TRAFFIC_DONTWALK)
+  {
+    c->walk = TRAFFIC_DONTWALK;
+    markwalk(c);
+  }
+  startgreen(c);
+  c->next = intervalend(c, now);
+}
+
+// ******** Traffic_SetClock ************
+// Tell a controller the time on the shared clock, e.g. from a time
+// server; it only affects coordination and the calendar
+// The time of the week is carried forward each Traffic_Run, so the
+// local time may wrap at 2^32 ms (49.7 days) as long as the
+// controller runs at least every 24 days
+// Inputs:  c is the controller
+//          shared is the shared clock in ms, counted from Sunday 00:00
+//          now is the current time in ticks (msec)
+// Outputs: none
+void Traffic_SetClock(trafficCtrl_t *c, uint32_t shared, uint32_t now)
+{
+  c->clockAt = now;
+  c->week = shared % TRAFFIC_WEEK;
+}
+
+// ******** Traffic_Coordinate ************
+// Run on the common cycle with phase 0 green at offset, or run free;
+// the controller moves to the new offset from the next cycle on
+// Inputs:  c is the controller
+//          offset is in ms into the cycle, or TRAFFIC_FREE
+// Outputs: 1 if successful, 0 if offset is not less than the cycle
+int Traffic_Coordinate(trafficCtrl_t *c, uint32_t offset)
+{
+  uint32_t cycle = Traffic_Cycle(c->layout);
+  if (offset == TRAFFIC_FREE)
+  {
+    cycle = 0;
+  }
+  else if (offset >= cycle)
+  {
+    return 0;
+  }
+  else
+  {
+    c->pressure = 0;
+  }
+  c->offset = offset;
+  c->cycle = cycle;
+  c->calendar = NULL;
+  return 1;
+}
+
+// ******** Traffic_Schedule ************
+// Follow a calendar of timing plans, or stop following one; from the
+// start of the next cycle on, each plan runs from its time in the week
+// on the shared clock until the next plan's time.  Turning it on ends
+// max pressure; Traffic_Coordinate and Traffic_SetPressure end it.
+// Inputs:  c is the controller
+//          calendar has at least one event, NULL to keep the plan in force
+// Outputs: 1 if successful, 0 if the events are out of order or a
+//          plan does not fit: other groups, phase greens or crossings, a cycle
+//          that is not Traffic_Cycle, an offset not less than it, or
+//          too long for the pedestrian wait
+int Traffic_Schedule(trafficCtrl_t *c, const trafficCalendar_t *calendar)
+{
+  const trafficLayout_t *layout;
+  const trafficPlan_t *plan;
+  int i, j;
+  if (calendar == NULL)
+  {
+    c->calendar = NULL;
+    return 1;
+  }
+  if (calendar->numEvents == 0)
+  {
+    return 0;
+  }
+  for (i = 0; i < calendar->numEvents; i++)
+  { // everything a swap could get wrong is checked here, once
+    plan = calendar->events[i].plan;
+    layout = plan->layout;
+    if ((calendar->events[i].at >= TRAFFIC_WEEK) ||
+        ((i > 0) && (calendar->events[i].at < calendar->events[i - 1].at)) ||
+        !validlayout(layout) || (layout->groups != c->layout->groups) ||
+        (layout->numGroups != c->layout->numGroups) ||
+        (layout->numPhases != c->layout->numPhases) ||
+        ((plan->offset != TRAFFIC_FREE) &&
+         ((plan->cycle != Traffic_Cycle(layout)) || (plan->offset >= plan->cycle))) ||
+        (c->pedMaxWait && (c->pedMaxWait < pedworst(layout))))
+    {
+      return 0;
+    }
+    for (j = 0; j < layout->numPhases; j++)
+    {
+      if ((layout->phases[j].green != c->layout->phases[j].green) ||
+          (!layout->phases[j].walk != !c->layout->phases[j].walk))
+      { // same groups green and the same crossings
+        return 0;
+      }
+    }
+  }
+  c->pressure = 0;
+  c->plan = NULL; // the first cycle boundary switches
+  c->calendar = calendar;
+  return 1;
+}
+
+// ******** Traffic_SetPressure ************
+// Pick phases by max pressure, or go back to running them in turn;
+// turning it on ends coordination
+// Inputs:  c is the controller
+//          on is nonzero for max pressure
+//          downstream[g] points to the count of cars ahead of group g's
+//          cars after the stop line, on the road and queued at its end,
+//          NULL if they leave; downstream may be
+//          NULL if no group has one
+// Outputs: none
+void Traffic_SetPressure(trafficCtrl_t *c, int on, const int *const *downstream)
+{
+  c->downstream = downstream;
+  if (on)
+  {
+    c->cycle = 0;
+    c->offset = TRAFFIC_FREE;
+    c->calendar = NULL;
+  }
+  c->pressure = on ? 1 : 0;
+}
+
+// ******** Traffic_SetPedWait ************
+// Bound how long a pedestrian waits from the call to the walk
+// Inputs:  c is the controller
+//          maxWait is in ticks (msec), 0 for no bound
+// Outputs: 1 if successful, 0 if the layout cannot promise maxWait
+int Traffic_SetPedWait(trafficCtrl_t *c, uint32_t maxWait)
+{
+  int i;
+  if (maxWait && (maxWait < pedworst(c->layout)))
+  {
+    return 0;
+  }
+  for (i = 0; maxWait && (c->calendar != NULL) && (i < c->calendar->numEvents); i++)
+  { // every plan it may switch to
+    if (maxWait < pedworst(c->calendar->events[i].plan->layout))
+    {
+      return 0;
+    }
+  }
+  c->pedMaxWait = maxWait;
+  return 1;
+}
+
+// ******** Traffic_Cycle ************
+// Length of the cycle of a layout run at fixed time
+// Inputs:  layout describes the intersection
+// Outputs: ms from one start of phase 0 to the next
+uint32_t Traffic_Cycle(const trafficLayout_t *layout)
+{
+  uint32_t cycle = 0;
+  int i;
+  for (i = 0; i < layout->numPhases; i++)
+  {
+    cycle += layout->phases[i].duration + clearance(layout, i);
+  }
+  return cycle;
+}
+
+// ******** Traffic_Run ************
+// Make every change of interval that is due by now
+// Inputs:  c is the controller
+//          now is the current time in ticks (msec)
+// Outputs: time of the next change, or for an actuated green
+//          the next time it could end
+uint32_t Traffic_Run(trafficCtrl_t *c, uint32_t now)
+{
+  const trafficPhase_t *p;
+  uint32_t end, walkEnd;
+  clockforward(c, now);
+  if (c->preempt != TRAFFIC_NOPREEMPT)
+  {
+    preemptnow(c, now);
+  }
+  if ((c->interval == TRAFFIC_GREEN) && (c->walk == TRAFFIC_DONTWALK) &&
+      pedcalled(c, c->phase) && walkfits(c, now))
+  { // called while the crossing's own phase is green
+    startwalk(c, now);
+  }
+  for (;;)
+  { // a late call runs through the missed intervals in order
+    end = intervalend(c, now);
+    if (c->walk != TRAFFIC_DONTWALK)
+    { // the crossing changes first, the green lasts until it has cleared
+      p = &c->layout->phases[c->phase]; // startgreen may have swapped the plan
+      walkEnd = c->walkStart + p->walk + ((c->walk == TRAFFIC_FLASH) ? p->pedClear : 0);
+      if ((int32_t)(now - walkEnd) < 0)
+      {
+        end = walkEnd;
+        break;
+      }
+      c->walk = (c->walk == TRAFFIC_WALK) ? TRAFFIC_FLASH : TRAFFIC_DONTWALK;
+      markwalk(c);
+      continue;
+    }
+    if ((int32_t)(now - end) < 0)
+    {
+      break;
+    }
+    c->start = end;
+    switch (c->interval)
+    {
+    case TRAFFIC_GREEN: // groups not green in the next phase clear
+      if (c->phase == c->preempt)
+      { // emergency over, the offset is found again from the next phase 0
+        c->preempt = TRAFFIC_NOPREEMPT;
+        c->error = 0;
+      }
+      c->target = (c->preempt != TRAFFIC_NOPREEMPT) ? c->preempt : nextphase(c);
+      if (c->pressure && (c->target == c->phase))
+      { // still the most pressure, another slot
+        startwalk(c, c->start);
+        break;
+      }
+      c->clearing = c->shown & ~c->layout->phases[c->target].green;
+      setgroups(c, c->clearing, YELLOW);
+      c->interval = TRAFFIC_YELLOW;
+      break;
+    case TRAFFIC_YELLOW:
+      setgroups(c, c->clearing, RED);
+      c->interval = TRAFFIC_ALLRED;
+      break;
+    default: // all-red over, next phase
+      c->phase = c->target;
+      c->clearing = 0;
+      setgroups(c, c->layout->phases[c->phase].green & ~c->shown, GREEN);
+      c->interval = TRAFFIC_GREEN;
+      startgreen(c);
+      break;
+    }
+  }
+  c->next = end;
+  return end;
+}
+
+// ******** Traffic_Detect ************
+// Report a car at the detector of a signal group
+// May be called from a detector ISR
+// Inputs:  c is the controller
+//          g is the signal group
+//          now is the current time in ticks (msec)
+// Outputs: none
+void Traffic_Detect(trafficCtrl_t *c, int g, uint32_t now)
+{
+  c->lights[g].timer = now;
+  c->lights[g].cars++;
+  c->lights[g].queue++;
+  if (c->lights[g].state != GREEN)
+  {
+    c->calls |= 1u << g;
+  }
+}
+
+// ******** Traffic_PedCall ************
+// Latch a pedestrian call for the crossing that walks with a phase;
+// the controller acts on it the next time it runs
+// May be called from a button ISR
+// Inputs:  c is the controller
+//          phase has the crossing, less than 32
+//          now is the current time in ticks (msec)
+// Outputs: 1 if successful, 0 if the phase has no crossing
+int Traffic_PedCall(trafficCtrl_t *c, uint8_t phase, uint32_t now)
+{
+  if ((phase >= c->layout->numPhases) || (phase >= 32) || (c->layout->phases[phase].walk == 0))
+  {
+    return 0;
+  }
+  if (c->pedCalls == 0)
+  { // later calls wait no longer than this one
+    c->pedDeadline = now + c->pedMaxWait;
+  }
+  c->pedCalls |= 1u << phase;
+  return 1;
+}
+
+// ******** Traffic_Preempt ************
+// Give an emergency vehicle the green of a phase as soon as it is
+// safe, and hold it; a later call for the same phase extends the
+// hold, one for another phase takes over.  The controller acts on it
+// the next time it runs.
+// Must not interrupt Traffic_Run
+// Inputs:  c is the controller
+//          phase is the phase the vehicle needs
+//          hold is in ticks (msec), how long the green lasts after
+//          this call and at least after it comes up
+//          now is the current time in ticks (msec)
+// Outputs: 1 if successful, 0 if phase is out of range
+int Traffic_Preempt(trafficCtrl_t *c, uint8_t phase, uint32_t hold, uint32_t now)
+{
+  if (phase >= c->layout->numPhases)
+  {
+    return 0;
+  }
+  c->preemptHold = hold;
+  c->preemptUntil = now + hold;
+  c->preempt = phase;
+  return 1;
+}
+
+// ******** Traffic_PreemptBound ************
+// Longest a preemption waits for its green once the controller runs:
+// the longest yellow and all-red of any phase, since the request may
+// find any clearance under way, even one from its own phase
+// Inputs:  layout describes the intersection
+// Outputs: ticks (msec)
+uint32_t Traffic_PreemptBound(const trafficLayout_t *layout)
+{
+  const trafficPhase_t *p;
+  uint32_t worst = 0;
+  int i;
+  for (i = 0; i < layout->numPhases; i++)
+  { // a request may find any phase's clearance under way
+    p = &layout->phases[i];
+    if (p->yellow + p->allRed > worst)
+    {
+      worst = p->yellow + p->allRed;
+    }
+  }
+  return worst;
+}
+
+// ******** Traffic_Leave ************
+// Report a car past the stop line of a signal group
+// May be called from a detector ISR
+// Inputs:  c is the controller
+//          g is the signal group
+// Outputs: none
+void Traffic_Leave(trafficCtrl_t *c, int g)
+{
+  if (c->lights[g].queue > 0)
+  {
+    c->lights[g].queue--;
+  }
+}
+
+// ******** Traffic_Draw ************
+// Draw what has changed on the LCD since the last call, the whole
+// intersection the first time.  The controller itself never draws,
+// so a thread can do it while it holds the LCD's mutex; a change
+// made while it draws is drawn by the next call
+// Inputs:  c is a controller started with display nonzero
+// Outputs: none
+void Traffic_Draw(trafficCtrl_t *c)
+{
+  uint32_t stale = c->staleGroups;
+  int g;
+  while (stale)
+  { // unmark before drawing, so a change made meanwhile stays marked
+    g = lowestbit(stale);
+    stale &= stale - 1;
+    unmarkgroup(c, g);
+    drawgroup(c, g);
+  }
+  if (c->staleWalk)
+  {
+    c->staleWalk = 0;
+    drawwalk(c);
+  }
+}
+
+// the intersection on the LCD, one group per axis
+static const trafficGroup_t LCDGroups[NUMLIGHTS] = {
+    {{"North", "South"}, {7, 7}, {0, 12}},
+    {{"East", "West"}, {17, 0}, {6, 6}},
+};
+#if TRAFFIC_ACTUATED
+static const trafficPhase_t LCDPhases[] = {
+    {0x01, 20000, 4000, 2500, 3000, 1000, 5000, 4000}, // North-South green, 4 to 20 s, 2.5 s per car
+    {0x02, 20000, 4000, 2500, 3000, 1000, 5000, 4000}, // East-West green, walk 5 s, clear 4 s
+};
+#else
+static const trafficPhase_t LCDPhases[] = {
+    {0x01, 2000, 0, 0, 1000, 500, 1000, 1000}, // North-South green 2 s, yellow 1 s, all-red 0.5 s
+    {0x02, 2000, 0, 0, 1000, 500, 1000, 1000}, // East-West, walk 1 s, flashing 1 s
+};
+#endif
+static const trafficLayout_t LCDLayout = {LCDGroups, NUMLIGHTS, LCDPhases,
+                                          sizeof(LCDPhases) / sizeof(LCDPhases[0]), 0, 0};
+#if TRAFFIC_CALENDAR
+// other timing plans, with the same clearances so PreemptBoundMs holds
+static const trafficPhase_t LCDPeakPhases[] = {
+    {0x01, 2000, 0, 0, 1000, 500, 1000, 1000}, // North-South 2 s
+    {0x02, 3000, 0, 0, 1000, 500, 1000, 1000}, // East-West 3 s, the commute
+};
+static const trafficPhase_t LCDNightPhases[] = {
+    {0x01, 3000, 0, 0, 1000, 500, 1000, 1000}, // North-South 3 s, the main road
+    {0x02, 2000, 0, 0, 1000, 500, 1000, 1000}, // East-West 2 s
+};
+static const trafficLayout_t LCDPeak = {LCDGroups, NUMLIGHTS, LCDPeakPhases, 2, 0, 0};
+static const trafficLayout_t LCDNight = {LCDGroups, NUMLIGHTS, LCDNightPhases, 2, 0, 0};
+static const trafficPlan_t LCDPlans[] = {
+    {&LCDLayout, 0, TRAFFIC_FREE}, // day, the layout above run free
+    {&LCDPeak, 8000, 0},           // peak, coordinated on an 8 s cycle
+    {&LCDNight, 8000, TRAFFIC_FREE},
+};
+#define LCDWEEKDAY(d)                                                               \
+  {TRAFFIC_AT(d, 7, 0), &LCDPlans[1]}, {TRAFFIC_AT(d, 9, 30), &LCDPlans[0]},        \
+      {TRAFFIC_AT(d, 16, 0), &LCDPlans[1]}, {TRAFFIC_AT(d, 19, 0), &LCDPlans[0]},   \
+      {TRAFFIC_AT(d, 22, 0), &LCDPlans[2]}
+static const trafficEvent_t LCDEvents[] = {
+    {TRAFFIC_AT(0, 8, 0), &LCDPlans[0]}, {TRAFFIC_AT(0, 21, 0), &LCDPlans[2]}, // Sunday
+    LCDWEEKDAY(1), LCDWEEKDAY(2), LCDWEEKDAY(3), LCDWEEKDAY(4), LCDWEEKDAY(5),
+    {TRAFFIC_AT(6, 8, 0), &LCDPlans[0]}, {TRAFFIC_AT(6, 23, 0), &LCDPlans[2]}, // Saturday
+};
+static const trafficCalendar_t LCDCalendar = {LCDEvents, sizeof(LCDEvents) / sizeof(LCDEvents[0])};
+#endif
+TrafficLightPair TrafficLights[NUMLIGHTS];
+trafficCtrl_t TrafficCtrl;
+uint32_t PreemptBoundMs;
+uint32_t PreemptWorstMs;
+static uint32_t PreemptPressed; // OS time of the press being served
+static int PreemptWaiting;      // nonzero until its green comes up
+static void (*Redraw)(void);    // asks for Traffic_Draw with the LCD held
+
+// ******** AddTrafficLights ************
+// Start the LCD intersection on its calendar of plans; it is drawn
+// by whoever redraw asks to run Traffic_Draw(&TrafficCtrl) with the LCD
+// Inputs:  redraw is called when the intersection has changed, from
+//          SwitchTrafficLightTask and once here; it must not block,
+//          e.g. it posts an event to the active object that owns the LCD
+// Outputs: none
+void AddTrafficLights(void (*redraw)(void))
+{
+  Redraw = redraw;
+  Traffic_Init(&TrafficCtrl, &LCDLayout, TrafficLights, 1, OS_Time());
+  Traffic_SetPedWait(&TrafficCtrl, TRAFFIC_PEDWAIT);
+#if TRAFFIC_CALENDAR
+  Traffic_SetClock(&TrafficCtrl, TRAFFIC_BOOTCLOCK, OS_Time());
+  Traffic_Schedule(&TrafficCtrl, &LCDCalendar);
+#endif
+  // one tick or slot until SwitchTrafficLightTask runs, then the clearance
+  PreemptBoundMs = (OS_CYCLIC ? TRAFFIC_SLOT : 1) + Traffic_PreemptBound(&LCDLayout);
+  Redraw(); // the whole intersection
+}
+
+// ******** SwitchTrafficLightTask ************
+// Event thread that runs the LCD intersection, added with
+// OS_AddPeriodicEventThread; it re-arms itself with OS_ReleaseIn
+// as a one-shot, so it runs only when an interval ends, and leaves
+// the drawing to the redraw given to AddTrafficLights.  With
+// OS_CYCLIC it has a fixed slot in the frame table instead, added
+// with period TRAFFIC_SLOT, and makes whatever changes are due
+// Inputs:  none
+// Outputs: none
+void SwitchTrafficLightTask(void)
+{
+  uint32_t now = OS_Time();
+  uint32_t next = Traffic_Run(&TrafficCtrl, now);
+  uint32_t pressed = now;
+  long sr;
+  if ((TrafficCtrl.phase == TRAFFIC_EMERGENCY) && (TrafficCtrl.interval == TRAFFIC_GREEN))
+  { // the emergency green is up; EmergencyPress runs above the
+    // kernel's mask, so only PRIMASK keeps a new press out of the
+    // test and clear
+    sr = StartCritical();
+    if (PreemptWaiting)
+    {
+      pressed = PreemptPressed;
+      PreemptWaiting = 0;
+    }
+    EndCritical(sr);
+    if (now - pressed > PreemptWorstMs)
+    {
+      PreemptWorstMs = now - pressed;
+    }
+  }
+  if (TrafficCtrl.staleGroups || TrafficCtrl.staleWalk)
+  { // drawn from a thread, so it never cuts into another's use of the LCD
+    Redraw();
+  }
+#if OS_CYCLIC
+  (void)next; // runs again in its next slot
+#else
+  OS_ReleaseIn(&SwitchTrafficLightTask, next - now);
+#endif
+}
+
+// ******** PedestrianButtons ************
+// Task for BSP_Buttons_InitInterrupt: Button1 calls the crossing
+// that walks with North-South, Button2 the one with East-West, and
+// SwitchTrafficLightTask runs on the next tick to act on the call,
+// or with OS_CYCLIC in its next slot
+// Must run at the priority of the OS tick, so that it never
+// interrupts SwitchTrafficLightTask
+// Inputs:  pressed, bit 0 for Button1 and bit 1 for Button2
+// Outputs: none
+void PedestrianButtons(uint32_t pressed)
+{
+  uint32_t now = OS_Time();
+  if (pressed & 0x01)
+  {
+    Traffic_PedCall(&TrafficCtrl, 0, now);
+  }
+  if (pressed & 0x02)
+  {
+    Traffic_PedCall(&TrafficCtrl, 1, now);
+  }
+#if !OS_CYCLIC
+  OS_ReleaseIn(&SwitchTrafficLightTask, 0);
+#endif
+}
+
+// ******** EmergencyPress ************
+// First half of the emergency input, for BSP_Select_InitInterrupt:
+// notes the time of the press and nothing else, so it may run above
+// the kernel's interrupt mask and is never delayed by it
+// Inputs:  none
+// Outputs: none
+void EmergencyPress(void)
+{
+  if (!PreemptWaiting)
+  { // bounces and repeats time from the first press
+    PreemptPressed = OS_Time();
+    PreemptWaiting = 1;
+  }
+}
+
+// ******** EmergencyPreempt ************
+// Second half of the emergency input: preempts the LCD intersection
+// for TRAFFIC_EMERGENCY and runs SwitchTrafficLightTask on the next
+// tick, or with OS_CYCLIC in its next slot.  Must run at the
+// priority of the OS tick, so that it never
+// interrupts SwitchTrafficLightTask
+// Inputs:  none
+// Outputs: none
+void EmergencyPreempt(void)
+{
+  Traffic_Preempt(&TrafficCtrl, TRAFFIC_EMERGENCY, TRAFFIC_PREEMPTHOLD, OS_Time());
+#if !OS_CYCLIC
+  OS_ReleaseIn(&SwitchTrafficLightTask, 0);
+#endif
+}
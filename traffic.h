@@ -0,0 +1,440 @@
+// traffic.h
+// Runs on LM4F120/TM4C123/MSP432, and on a host for simulation
+// Table-driven traffic signal controller.  An intersection is
+// described by const tables: its signal groups (the lights that
+// always show the same colour, with where to draw them) and its
+// phases (which groups are green, and for how long).  One generic
+// transition moves a controller from phase to phase, touching only
+// the groups whose colour changes, so one controller can run many
+// groups and one program can run many controllers.
+//
+// Between phases the groups that lose their green show yellow and
+// then red for an all-red clearance, both timed by the phase being
+// left; groups green in both phases stay green.  So the sequence is
+// green, yellow, all-red, next green, and the controller only has to
+// run at those boundaries.
+//
+// A phase is fixed time, or vehicle actuated when it has a passage
+// time: it stays green for at least minGreen, then for passage after
+// each car its groups' detectors report (Traffic_Detect), and ends
+// when a gap that long opens up (gap out) or at duration (max out).
+// While no other group has a call, it rests in green.
+//
+// Controllers along a corridor can be coordinated (Traffic_Coordinate)
+// so that their greens form a green wave.  They then share a cycle,
+// the sum of the phase durations and clearances, and phase 0 turns
+// green at a fixed offset into each cycle of a shared clock
+// (Traffic_SetClock) rather than relative to boot.  Cycles are counted
+// from the start of the week on the shared clock; where the cycle does
+// not divide a week, every controller steps at the week boundary
+// together and corrects as after an offset change.  A coordinated
+// green lasts its full duration, its split.  When the offset changes,
+// or a controller starts out of step, the difference is made up by
+// shortening or stretching each green by at most TRAFFIC_CORRECT
+// percent, whichever way is shorter, so there is no abrupt jump.
+//
+// Alternatively a controller can run max pressure (Traffic_SetPressure).
+// Its greens are then slots of one duration each, and at the end of
+// each slot it picks the phase with the most pressure: the cars
+// queued on its groups less the cars already where they are going.
+// Queues count cars between the detector (Traffic_Detect) and the
+// stop line (Traffic_Leave); downstream counts are read through
+// pointers, to a neighbour's TrafficLightPair or to values kept up to
+// date from the network, best the cars on the road as well as those
+// queued at its end.  A group with no cars, or with more ahead of
+// them than behind, adds no pressure.  The phase in green keeps it
+// for another slot unless another phase has TRAFFIC_PRESSUREHOLD
+// more, since a change wastes the clearance.  The choice costs one
+// pass over the groups and one over the phases' groups, so it is
+// cheap enough for the event thread.
+//
+// A phase can have a pedestrian crossing that walks with it.  A
+// push-button call (Traffic_PedCall, e.g. from a GPIO edge ISR) is
+// latched and served with a walk, then flashing don't walk, at the
+// start of the phase's next green, or at once if the phase is green
+// and the crossing fits in what is left of it.  The green is never
+// cut short for the walk: fixed-time and coordinated greens must be
+// long enough for it, and an actuated green is kept for it within
+// its maximum.  With a maximum wait (Traffic_SetPedWait) actuated
+// greens are ended early, though never before their minimum, so
+// that the crossing is reached in time; the wait is checked against
+// the worst case when every green runs as short as it may.
+//
+// An emergency vehicle preempts the sequence (Traffic_Preempt): the
+// green it needs comes up as soon as the groups in its way have had
+// their full yellow and all-red, so never later than
+// Traffic_PreemptBound after the controller runs.  A green in the way
+// is ended at once, below its minimum if need be, and a walk is cut
+// off; a clearance already under way is redirected, and groups it was
+// going to keep green get a yellow of their own.  The emergency green
+// is held for a given time after the last call, then the sequence
+// resumes with the next phase and a coordinated controller moves back
+// to its offset as it would after any change, TRAFFIC_CORRECT at a
+// time.
+//
+// Timing plans can follow a calendar (Traffic_Schedule).  A plan is a
+// const layout with the same groups and phase greens as the others,
+// giving the splits and so the cycle, plus an offset; a calendar is a
+// const table of the times in the week each plan starts, on the
+// shared clock counted from Sunday 00:00.  All of it is checked when
+// the calendar is given, so at the start of each cycle the controller
+// only looks up the plan in force and, if it changed, swaps the
+// layout pointer and offset; the next cycle is then corrected towards
+// the new offset like any other change.
+//
+// Example, a four-way intersection with one group per axis:
+//   static const trafficGroup_t Groups[2] = {
+//     {{"North", "South"}, {7, 7}, {0, 12}},
+//     {{"East", "West"}, {17, 0}, {6, 6}}};
+//   static const trafficPhase_t Phases[2] = {{0x01, 2000}, {0x02, 2000}};
+//   static const trafficLayout_t Layout = {Groups, 2, Phases, 2};
+//   Traffic_Init(&Ctrl, &Layout, Lights, 1, OS_Time());
+//   ... next = Traffic_Run(&Ctrl, OS_Time()); at or after each change
+
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+#include <stdint.h>
+
+#define NUMLIGHTS 2        // signal groups of the intersection on the LCD
+#define TRAFFIC_MAXGROUPS 32 // groups in one controller, one bit each
+#define TRAFFIC_LABELS 2   // LCD labels per signal group
+#define TRAFFIC_ACTUATED 0 // 1 if the LCD intersection has vehicle detectors
+#define TRAFFIC_CALENDAR 1 // 1 if the LCD intersection follows its calendar of plans
+#define TRAFFIC_CORRECT 20 // percent of a green a coordinated controller may add or take away
+#define TRAFFIC_PRESSUREHOLD 2 // cars of pressure a max pressure change of phase must gain,
+                               // about what the yellow and all-red cost
+#define TRAFFIC_FREE 0xFFFFFFFF // offset of a controller that is not coordinated
+#define TRAFFIC_PEDWAIT 30000 // ms, longest a pedestrian at the LCD intersection waits for a walk
+#define TRAFFIC_NOPREEMPT 0xFF // preempt of a controller with no emergency vehicle
+#define TRAFFIC_EMERGENCY 1   // phase an emergency vehicle at the LCD intersection needs
+#define TRAFFIC_PREEMPTHOLD 4000 // ms the LCD intersection holds it green after the last call
+#define TRAFFIC_SLOT 10 // ms between runs of the LCD intersection with OS_CYCLIC
+#define TRAFFIC_DAY 86400000     // ms
+#define TRAFFIC_WEEK (7 * TRAFFIC_DAY)
+// ms into the week on the shared clock, day 0 is Sunday
+#define TRAFFIC_AT(day, hour, minute) ((day) * TRAFFIC_DAY + ((hour) * 60 + (minute)) * 60000)
+#define TRAFFIC_BOOTCLOCK TRAFFIC_AT(1, 6, 59) // shared clock at boot until a time source sets it
+
+typedef enum
+{
+  RED,
+  GREEN,
+  YELLOW,
+} TrafficLightState;
+
+// where the controller is between two phases
+typedef enum
+{
+  TRAFFIC_GREEN,  // phase running
+  TRAFFIC_YELLOW, // groups leaving green show yellow
+  TRAFFIC_ALLRED, // clearance before the next phase
+} trafficInterval_t;
+
+// pedestrian signal of the crossing that walks with the current phase
+typedef enum
+{
+  TRAFFIC_DONTWALK,
+  TRAFFIC_WALK,
+  TRAFFIC_FLASH, // flashing don't walk, the crossing clears
+} trafficWalk_t;
+
+// live state of one signal group
+typedef struct
+{
+  int pair;                // index of the group in its layout
+  TrafficLightState state;
+  int timer;               // time of the last detected car, ticks (msec)
+  int cars;                // cars detected since the group last turned green
+  int queue;               // cars past the detector, not yet past the stop line
+} TrafficLightPair;
+
+// where a signal group is drawn, label NULL if not drawn
+typedef struct
+{
+  const char *label[TRAFFIC_LABELS];
+  uint8_t x[TRAFFIC_LABELS]; // LCD column
+  uint8_t y[TRAFFIC_LABELS]; // LCD row
+} trafficGroup_t;
+
+// one phase of the cycle
+typedef struct
+{
+  uint32_t green;    // bit g set if group g is green in this phase
+  uint32_t duration; // ticks (msec), the maximum green if actuated
+  uint32_t minGreen; // ticks, actuated only
+  uint32_t passage;  // ticks of green each car adds, 0 for fixed time
+  uint32_t yellow;   // ticks of yellow after this phase
+  uint32_t allRed;   // ticks of all-red clearance after the yellow
+  uint32_t walk;     // ticks of walk for the crossing with this phase, 0 if none
+  uint32_t pedClear; // ticks of flashing don't walk after the walk
+} trafficPhase_t;
+
+// an intersection, normally a const table
+typedef struct
+{
+  const trafficGroup_t *groups;
+  uint8_t numGroups;
+  const trafficPhase_t *phases;
+  uint8_t numPhases;
+  uint8_t walkX, walkY;     // where the pedestrian signal is drawn
+} trafficLayout_t;
+
+// a timing plan, normally a const table
+typedef struct
+{
+  const trafficLayout_t *layout; // the splits, same groups and phase greens in every plan
+  uint32_t cycle;                // ms, Traffic_Cycle(layout), unused if free
+  uint32_t offset;               // ms into the cycle phase 0 turns green, or TRAFFIC_FREE
+} trafficPlan_t;
+
+// a plan starts at a time in the week
+typedef struct
+{
+  uint32_t at; // ms since Sunday 00:00, TRAFFIC_AT
+  const trafficPlan_t *plan;
+} trafficEvent_t;
+
+// a week of plans, normally a const table
+typedef struct
+{
+  const trafficEvent_t *events; // in order of time, the last runs on into the next week
+  uint8_t numEvents;
+} trafficCalendar_t;
+
+// one controller instance
+typedef struct
+{
+  const trafficLayout_t *layout;
+  TrafficLightPair *lights; // numGroups entries, owned by the caller
+  uint32_t shown;           // bit g set while group g shows green
+  uint32_t calls;           // bit g set while group g has cars waiting
+  uint32_t clearing;        // groups in the yellow and all-red after a phase
+  uint32_t start;           // time the current interval started
+  uint32_t next;            // time of the next change, or to check for one
+  uint8_t phase;            // current phase, or the one being cleared
+  uint8_t target;           // phase that follows the clearance
+  uint8_t interval;         // trafficInterval_t
+  uint8_t display;          // nonzero to draw on the LCD
+  uint8_t staleWalk;        // nonzero while the pedestrian signal must be redrawn
+  uint32_t staleGroups;     // bit g set while group g must be redrawn
+  uint32_t cycle;           // ms, 0 if not coordinated
+  uint32_t offset;          // phase 0 turns green this far into each cycle of the shared clock
+  uint32_t clockAt;         // local time the week position was taken at
+  uint32_t week;            // ms into the week on the shared clock at clockAt
+  int32_t error;            // ms the cycle runs late, negative if early, still to make up
+  int32_t adjust;           // ms taken off the current green, negative if added
+  const int *const *downstream; // per group, queue its cars join next, NULL if none
+  uint8_t pressure;         // nonzero to pick phases by max pressure
+  uint32_t pedCalls;        // bit i set while a pedestrian waits for phase i
+  uint32_t pedDeadline;     // when the oldest waiting pedestrian must get a walk
+  uint32_t pedMaxWait;      // ticks, 0 for no bound
+  uint32_t walkStart;       // time the current walk started
+  uint8_t walk;             // trafficWalk_t
+  uint8_t preempt;          // phase an emergency vehicle needs, or TRAFFIC_NOPREEMPT
+  uint32_t preemptHold;     // ticks its green is held at least
+  uint32_t preemptUntil;    // time its green may end
+  const trafficCalendar_t *calendar; // plans to follow, NULL if none
+  const trafficPlan_t *plan;         // plan in force, NULL until the first swap
+} trafficCtrl_t;
+
+// ******** Traffic_Init ************
+// Start a controller in phase 0
+// Inputs:  c is the controller, which must stay allocated
+//          layout describes the intersection, at most TRAFFIC_MAXGROUPS groups
+//          lights is storage for the state of each group
+//          display is nonzero if this controller is drawn on the LCD,
+//          by Traffic_Draw
+//          now is the current time in ticks (msec)
+// Outputs: 1 if successful, 0 if the layout is invalid
+int Traffic_Init(trafficCtrl_t *c, const trafficLayout_t *layout, TrafficLightPair *lights,
+                 int display, uint32_t now);
+
+// ******** Traffic_SetPhase ************
+// Switch to a phase now, without yellow or all-red, for start-up or
+// tests; only groups whose colour changes are updated
+// Inputs:  c is the controller
+//          phase is the new phase, less than numPhases
+//          now is the current time in ticks (msec)
+// Outputs: none
+void Traffic_SetPhase(trafficCtrl_t *c, uint8_t phase, uint32_t now);
+
+// ******** Traffic_SetClock ************
+// Tell a controller the time on the shared clock, e.g. from a time
+// server; it only affects coordination and the calendar
+// The time of the week is carried forward each Traffic_Run, so the
+// local time may wrap at 2^32 ms (49.7 days) as long as the
+// controller runs at least every 24 days
+// Inputs:  c is the controller
+//          shared is the shared clock in ms, counted from Sunday 00:00
+//          now is the current time in ticks (msec)
+// Outputs: none
+void Traffic_SetClock(trafficCtrl_t *c, uint32_t shared, uint32_t now);
+
+// ******** Traffic_Coordinate ************
+// Run on the common cycle with phase 0 green at offset, or run free;
+// the controller moves to the new offset from the next cycle on
+// Inputs:  c is the controller
+//          offset is in ms into the cycle, or TRAFFIC_FREE
+// Outputs: 1 if successful, 0 if offset is not less than the cycle
+int Traffic_Coordinate(trafficCtrl_t *c, uint32_t offset);
+
+// ******** Traffic_Schedule ************
+// Follow a calendar of timing plans, or stop following one; from the
+// start of the next cycle on, each plan runs from its time in the week
+// on the shared clock until the next plan's time.  Turning it on ends
+// max pressure; Traffic_Coordinate and Traffic_SetPressure end it.
+// Inputs:  c is the controller
+//          calendar has at least one event, NULL to keep the plan in force
+// Outputs: 1 if successful, 0 if the events are out of order or a
+//          plan does not fit: other groups, phase greens or crossings, a cycle
+//          that is not Traffic_Cycle, an offset not less than it, or
+//          too long for the pedestrian wait
+int Traffic_Schedule(trafficCtrl_t *c, const trafficCalendar_t *calendar);
+
+// ******** Traffic_SetPressure ************
+// Pick phases by max pressure, or go back to running them in turn;
+// turning it on ends coordination
+// Inputs:  c is the controller
+//          on is nonzero for max pressure
+//          downstream[g] points to the count of cars ahead of group g's
+//          cars after the stop line, on the road and queued at its end,
+//          NULL if they leave; downstream may be
+//          NULL if no group has one
+// Outputs: none
+void Traffic_SetPressure(trafficCtrl_t *c, int on, const int *const *downstream);
+
+// ******** Traffic_SetPedWait ************
+// Bound how long a pedestrian waits from the call to the walk
+// Inputs:  c is the controller
+//          maxWait is in ticks (msec), 0 for no bound
+// Outputs: 1 if successful, 0 if the layout cannot promise maxWait
+int Traffic_SetPedWait(trafficCtrl_t *c, uint32_t maxWait);
+
+// ******** Traffic_Cycle ************
+// Length of the cycle of a layout run at fixed time
+// Inputs:  layout describes the intersection
+// Outputs: ms from one start of phase 0 to the next
+uint32_t Traffic_Cycle(const trafficLayout_t *layout);
+
+// ******** Traffic_Run ************
+// Make every change of interval that is due by now
+// Inputs:  c is the controller
+//          now is the current time in ticks (msec)
+// Outputs: time of the next change, or for an actuated green
+//          the next time it could end
+uint32_t Traffic_Run(trafficCtrl_t *c, uint32_t now);
+
+// ******** Traffic_Detect ************
+// Report a car at the detector of a signal group
+// May be called from a detector ISR
+// Inputs:  c is the controller
+//          g is the signal group
+//          now is the current time in ticks (msec)
+// Outputs: none
+void Traffic_Detect(trafficCtrl_t *c, int g, uint32_t now);
+
+// ******** Traffic_PedCall ************
+// Latch a pedestrian call for the crossing that walks with a phase;
+// the controller acts on it the next time it runs
+// May be called from a button ISR
+// Inputs:  c is the controller
+//          phase has the crossing, less than 32
+//          now is the current time in ticks (msec)
+// Outputs: 1 if successful, 0 if the phase has no crossing
+int Traffic_PedCall(trafficCtrl_t *c, uint8_t phase, uint32_t now);
+
+// ******** Traffic_Preempt ************
+// Give an emergency vehicle the green of a phase as soon as it is
+// safe, and hold it; a later call for the same phase extends the
+// hold, one for another phase takes over.  The controller acts on it
+// the next time it runs.
+// Must not interrupt Traffic_Run
+// Inputs:  c is the controller
+//          phase is the phase the vehicle needs
+//          hold is in ticks (msec), how long the green lasts after
+//          this call and at least after it comes up
+//          now is the current time in ticks (msec)
+// Outputs: 1 if successful, 0 if phase is out of range
+int Traffic_Preempt(trafficCtrl_t *c, uint8_t phase, uint32_t hold, uint32_t now);
+
+// ******** Traffic_PreemptBound ************
+// Longest a preemption waits for its green once the controller runs:
+// the longest yellow and all-red of any phase, since the request may
+// find any clearance under way, even one from its own phase
+// Inputs:  layout describes the intersection
+// Outputs: ticks (msec)
+uint32_t Traffic_PreemptBound(const trafficLayout_t *layout);
+
+// ******** Traffic_Leave ************
+// Report a car past the stop line of a signal group
+// May be called from a detector ISR
+// Inputs:  c is the controller
+//          g is the signal group
+// Outputs: none
+void Traffic_Leave(trafficCtrl_t *c, int g);
+
+// ******** Traffic_Draw ************
+// Draw what has changed on the LCD since the last call, the whole
+// intersection the first time.  The controller itself never draws,
+// so a thread can do it while it holds the LCD's mutex; a change
+// made while it draws is drawn by the next call
+// Inputs:  c is a controller started with display nonzero
+// Outputs: none
+void Traffic_Draw(trafficCtrl_t *c);
+
+// the intersection drawn on the LCD
+extern TrafficLightPair TrafficLights[NUMLIGHTS];
+extern trafficCtrl_t TrafficCtrl;
+extern uint32_t PreemptBoundMs; // guaranteed emergency input to green time, ms
+extern uint32_t PreemptWorstMs; // worst input to green time measured, ms
+
+// ******** AddTrafficLights ************
+// Start the LCD intersection on its calendar of plans; it is drawn
+// by whoever redraw asks to run Traffic_Draw(&TrafficCtrl) with the LCD
+// Inputs:  redraw is called when the intersection has changed, from
+//          SwitchTrafficLightTask and once here; it must not block,
+//          e.g. it posts an event to the active object that owns the LCD
+// Outputs: none
+void AddTrafficLights(void (*redraw)(void));
+
+// ******** SwitchTrafficLightTask ************
+// Event thread that runs the LCD intersection, added with
+// OS_AddPeriodicEventThread; it re-arms itself with OS_ReleaseIn
+// as a one-shot, so it runs only when an interval ends, and leaves
+// the drawing to the redraw given to AddTrafficLights.  With
+// OS_CYCLIC it has a fixed slot in the frame table instead, added
+// with period TRAFFIC_SLOT, and makes whatever changes are due
+// Inputs:  none
+// Outputs: none
+void SwitchTrafficLightTask(void);
+
+// ******** PedestrianButtons ************
+// Task for BSP_Buttons_InitInterrupt: Button1 calls the crossing
+// that walks with North-South, Button2 the one with East-West, and
+// SwitchTrafficLightTask runs on the next tick to act on the call,
+// or with OS_CYCLIC in its next slot
+// Must run at the priority of the OS tick, so that it never
+// interrupts SwitchTrafficLightTask
+// Inputs:  pressed, bit 0 for Button1 and bit 1 for Button2
+// Outputs: none
+void PedestrianButtons(uint32_t pressed);
+
+// ******** EmergencyPress ************
+// First half of the emergency input, for BSP_Select_InitInterrupt:
+// notes the time of the press and nothing else, so it may run above
+// the kernel's interrupt mask and is never delayed by it
+// Inputs:  none
+// Outputs: none
+void EmergencyPress(void);
+
+// ******** EmergencyPreempt ************
+// Second half of the emergency input: preempts the LCD intersection
+// for TRAFFIC_EMERGENCY and runs SwitchTrafficLightTask on the next
+// tick, or with OS_CYCLIC in its next slot.  Must run at the
+// priority of the OS tick, so that it never
+// interrupts SwitchTrafficLightTask
+// Inputs:  none
+// Outputs: none
+void EmergencyPreempt(void);
+
+#endif